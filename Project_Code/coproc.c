@@ -0,0 +1,242 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "parsing.h"
+#include "trace.h"
+#include "coproc.h"
+
+static coproc_t coprocs[MAXCOPROC];
+static unsigned int n_coprocs = 0;
+
+
+/**************************************************************************************************************************
+Function that returns the coprocess with the name, or NULL if it doesn't exist.
+**************************************************************************************************************************/
+static coproc_t *findCoproc(const char *name)
+{
+	for (unsigned int i = 0; i < n_coprocs; i++)
+		if (strcmp(coprocs[i].name, name) == 0)
+			return &coprocs[i];
+	return NULL;
+}
+
+
+/**************************************************************************************************************************
+Function that starts the command of the coprocess with two new pipes.
+The coprocess has its own process group, so the deadline of a command line and the ctrl+C don't reach it.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+static unsigned int startCoproc(coproc_t * c)
+{
+	int to[2], from[2];	// to: from the shell to the coprocess, from: from the coprocess to the shell
+	pid_t pid;
+	uint64_t fork_start;
+	if (pipe2(to, O_CLOEXEC) == -1)
+		return 0;
+	if (pipe2(from, O_CLOEXEC) == -1) {
+		close(to[0]);
+		close(to[1]);
+		return 0;
+	}
+	fflush(stdout);
+	fork_start = trace_on ? traceNow() : 0;
+	if ((pid = fork()) == 0) {
+		setpgid(0, 0);
+		signal(SIGPIPE, SIG_DFL);
+		if (dup2(to[0], STDIN_FILENO) == -1 || dup2(from[1], STDOUT_FILENO) == -1)
+			_exit(EXIT_FAILURE);
+		traceChild(EV_EXEC, c->argv, 0);
+		execvp(c->argv[0], c->argv);
+		fprintf(stdout, RED "*** COMANDO ERRATO!!! *** - Errore di: %s" RESET_COLOR "\n", c->argv[0]);
+		fflush(stdout);
+		_exit(127);
+	}
+	close(to[0]);
+	close(from[1]);
+	if (pid < 0) {
+		perror("Errore fork in coproc\n");
+		close(to[1]);
+		close(from[0]);
+		return 0;
+	}
+	setpgid(pid, pid);
+	traceEvent(EV_FORK, fork_start, pid, c->argv, -1, 0);
+	c->pid = pid;
+	c->in = to[1];
+	c->out = from[0];
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that closes the pipes of a coprocess (so it sees the end of its input) and waits for it.
+If it doesn't terminate within a short time it is killed.
+**************************************************************************************************************************/
+static void stopCoproc(coproc_t * c)
+{
+	int status;
+	close(c->in);
+	close(c->out);
+	for (int i = 0; i < 50 && waitpid(c->pid, &status, WNOHANG) == 0; i++)	// up to half a second
+		usleep(10000);
+	if (waitpid(c->pid, &status, WNOHANG) == 0) {
+		kill(-c->pid, SIGKILL);
+		waitpid(c->pid, &status, 0);
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that removes a coprocess from the table.
+**************************************************************************************************************************/
+static void removeCoproc(coproc_t * c)
+{
+	for (char **a = c->argv; *a != NULL; a++)
+		free(*a);
+	free(c->argv);
+	*c = coprocs[--n_coprocs];
+}
+
+
+/**************************************************************************************************************************
+Function for executing the "coproc" command: "coproc NAME comm [args]" starts a coprocess, "coproc -k NAME" terminates
+it and "coproc" prints the ones in execution.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int coproc(char **arg, unsigned int num_arg)
+{
+	coproc_t *c;
+	unsigned int i;
+	if (num_arg == 1) {
+		for (i = 0; i < n_coprocs; i++)
+			fprintf(stdout, "%s\t%d\t%u\n", coprocs[i].name, coprocs[i].pid, coprocs[i].restarts);
+		return 1;
+	}
+	if (num_arg == 3 && strcmp(arg[1], "-k") == 0) {
+		if ((c = findCoproc(arg[2])) == NULL) {
+			fprintf(stdout, RED "micro-bash: coproc: %s: coprocesso non esistente" RESET_COLOR "\n", arg[2]);
+			return 0;
+		}
+		stopCoproc(c);
+		removeCoproc(c);
+		return 1;
+	}
+	if (num_arg < 3 || strlen(arg[1]) >= MAXCOPROCNAME || isdigit((unsigned char)arg[1][0]) || arg[1][0] == '-') {
+		fprintf(stdout, RED "micro-bash: coproc: uso: coproc [NOME comando [argomenti] | -k NOME]" RESET_COLOR "\n");
+		return 0;
+	}
+	for (i = 0; arg[1][i]; i++)
+		if (!isalnum((unsigned char)arg[1][i]) && arg[1][i] != '_') {
+			fprintf(stdout, RED "micro-bash: coproc: %s: nome non valido" RESET_COLOR "\n", arg[1]);
+			return 0;
+		}
+	if (findCoproc(arg[1]) != NULL) {
+		fprintf(stdout, RED "micro-bash: coproc: %s: coprocesso già esistente" RESET_COLOR "\n", arg[1]);
+		return 0;
+	}
+	if (n_coprocs == MAXCOPROC) {
+		fprintf(stdout, RED "micro-bash: coproc: troppi coprocessi" RESET_COLOR "\n");
+		return 0;
+	}
+	c = &coprocs[n_coprocs];
+	strcpy(c->name, arg[1]);
+	c->argv = malloc(sizeof(char *) * (num_arg - 1));	// the arguments of the queue are freed at the end of the line
+	for (i = 2; i < num_arg; i++)
+		c->argv[i - 2] = strdup(arg[i]);
+	c->argv[num_arg - 2] = NULL;
+	c->restarts = 0;
+	n_coprocs++;
+	if (!startCoproc(c)) {
+		removeCoproc(c);
+		return 0;
+	}
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function to be used at the beginning of each command line: it reaps the coprocesses that have terminated and restarts
+the ones that have crashed (killed by a signal or with status different from 0).
+**************************************************************************************************************************/
+void coprocCheck()
+{
+	int status;
+	for (unsigned int i = 0; i < n_coprocs; i++) {
+		coproc_t *c = &coprocs[i];
+		if (waitpid(c->pid, &status, WNOHANG) != c->pid)	// still in execution
+			continue;
+		traceEvent(EV_WAIT, 0, c->pid, c->argv, -1, status);
+		close(c->in);
+		close(c->out);
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {	// it has finished its work
+			fprintf(stdout, LIGHT_BLUE "Il coprocesso %s (pid %d) è terminato" RESET_COLOR "\n", c->name, c->pid);
+			removeCoproc(c);
+			i--;
+			continue;
+		}
+		if (c->restarts == COPROC_MAX_RESTARTS || (WIFEXITED(status) && WEXITSTATUS(status) == 127)) {	// 127: the command doesn't exist
+			fprintf(stdout, RED "Il coprocesso %s (pid %d) è terminato in modo anomalo e non viene riavviato" RESET_COLOR "\n", c->name, c->pid);
+			removeCoproc(c);
+			i--;
+			continue;
+		}
+		fprintf(stdout, LIGHT_BLUE "Il coprocesso %s (pid %d) è terminato in modo anomalo: lo riavvio" RESET_COLOR "\n", c->name, c->pid);
+		c->restarts++;
+		if (!startCoproc(c)) {
+			removeCoproc(c);
+			i--;
+		}
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that returns the file descriptor of the shell for the redirection ">&NAME" (output 1, the standard input of the
+coprocess) or "<&NAME" (output 0, its standard output).
+It returns -1 if the coprocess doesn't exist.
+**************************************************************************************************************************/
+int coprocFd(const char *name, unsigned int output)
+{
+	coproc_t *c = findCoproc(name);
+	if (c == NULL) {
+		fprintf(stdout, RED "micro-bash: %s: coprocesso non esistente" RESET_COLOR "\n", name);
+		return -1;
+	}
+	return output ? c->in : c->out;
+}
+
+
+/**************************************************************************************************************************
+Function that writes in fds the file descriptors of the shell for the pipes of all the coprocesses.
+It returns their number (at most 2 * MAXCOPROC).
+**************************************************************************************************************************/
+unsigned int coprocFds(int *fds)
+{
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < n_coprocs; i++) {
+		fds[n++] = coprocs[i].in;
+		fds[n++] = coprocs[i].out;
+	}
+	return n;
+}
+
+
+/**************************************************************************************************************************
+Function to be used when the shell ends: it closes the pipes of the coprocesses and waits for them.
+**************************************************************************************************************************/
+void coprocEnd()
+{
+	while (n_coprocs > 0) {
+		stopCoproc(&coprocs[0]);
+		removeCoproc(&coprocs[0]);
+	}
+}
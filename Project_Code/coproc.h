@@ -0,0 +1,51 @@
+#define MAXCOPROC 16	// maximum number of coprocesses at the same time
+#define MAXCOPROCNAME 32	// maximum number of characters of the name of a coprocess
+#define COPROC_MAX_RESTARTS 5	// after this number of crashes the coprocess is not restarted
+
+
+/**************************************************************************************************************************
+Coproc Struct: a command that remains in execution between the command lines, with its arguments (copied), its pid, the
+file descriptor of the shell that writes in its standard input and the one that reads its standard output.
+**************************************************************************************************************************/
+typedef struct {
+	char name[MAXCOPROCNAME], **argv;
+	pid_t pid;
+	int in, out;
+	unsigned int restarts;
+} coproc_t;
+
+
+/**************************************************************************************************************************
+Function for executing the "coproc" command: "coproc NAME comm [args]" starts a coprocess, "coproc -k NAME" terminates
+it and "coproc" prints the ones in execution.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int coproc(char **, unsigned int);
+
+
+/**************************************************************************************************************************
+Function to be used at the beginning of each command line: it reaps the coprocesses that have terminated and restarts
+the ones that have crashed (killed by a signal or with status different from 0).
+**************************************************************************************************************************/
+void coprocCheck();
+
+
+/**************************************************************************************************************************
+Function that returns the file descriptor of the shell for the redirection ">&NAME" (output 1, the standard input of the
+coprocess) or "<&NAME" (output 0, its standard output).
+It returns -1 if the coprocess doesn't exist.
+**************************************************************************************************************************/
+int coprocFd(const char *, unsigned int);
+
+
+/**************************************************************************************************************************
+Function that writes in fds the file descriptors of the shell for the pipes of all the coprocesses.
+It returns their number (at most 2 * MAXCOPROC).
+**************************************************************************************************************************/
+unsigned int coprocFds(int *);
+
+
+/**************************************************************************************************************************
+Function to be used when the shell ends: it closes the pipes of the coprocesses and waits for them.
+**************************************************************************************************************************/
+void coprocEnd();
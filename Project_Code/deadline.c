@@ -0,0 +1,306 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include "parsing.h"
+#include "options.h"
+#include "deadline.h"
+#include "trace.h"
+
+#define MAXEVENTS 16	// maximum number of events read with one epoll_wait
+
+static long long cur_deadline = 0;	// deadline of the command line in nanoseconds (0 if there is none)
+static long long cur_grace = DEADLINE_GRACE;	// time between SIGTERM and SIGKILL
+static pid_t pgid = 0;	// process group of the pipeline (0 before the first fork)
+static unsigned int tty_given = 0;	// 1 if the terminal has been given to the process group of the pipeline
+
+
+/**************************************************************************************************************************
+Function that reads the "timeout [-k GRACE] DURATION" prefix at the beginning of the queue and removes it from the queue.
+Without prefix the deadline of the shell is used ("set -o deadline=...").
+It returns 0 if some error occurred, otherwise it returns 1 (also when there is no prefix).
+**************************************************************************************************************************/
+unsigned int deadlineBegin(queue * q)
+{
+	long long duration;
+	if (cur_deadline == 0)
+		cur_deadline = opts.deadline;
+	if (isEmpty(q) || strcmp(q->array[q->first], "timeout") != 0)
+		return 1;
+	dequeue(q);
+	if (!isEmpty(q) && strcmp(q->array[q->first], "-k") == 0) {
+		dequeue(q);
+		if (isEmpty(q) || (cur_grace = parseDuration(dequeue(q))) < 0) {
+			fprintf(stdout, RED "micro-bash: timeout: -k: durata non valida" RESET_COLOR "\n");
+			deadlineEnd();
+			return 0;
+		}
+	}
+	if (isEmpty(q) || (duration = parseDuration(dequeue(q))) <= 0) {
+		fprintf(stdout, RED "micro-bash: timeout: durata non valida" RESET_COLOR "\n");
+		deadlineEnd();
+		return 0;
+	}
+	if (isEmpty(q)) {	// "timeout" without a command
+		fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
+		deadlineEnd();
+		return 0;
+	}
+	if (cur_deadline == 0 || duration < cur_deadline)	// the deadline of the shell is still valid if it is shorter
+		cur_deadline = duration;
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that makes group the foreground process group of the terminal, if the standard input is a terminal.
+SIGTTOU is ignored during the call, because a process that is not in the foreground group would be stopped.
+It returns 1 if the terminal has been given, otherwise 0.
+**************************************************************************************************************************/
+static unsigned int giveTerminal(pid_t group)
+{
+	void (*old)(int);
+	unsigned int ok;
+	if (!isatty(STDIN_FILENO))
+		return 0;
+	old = signal(SIGTTOU, SIG_IGN);
+	ok = tcsetpgrp(STDIN_FILENO, group) == 0;
+	signal(SIGTTOU, old);
+	return ok;
+}
+
+
+/**************************************************************************************************************************
+Function to be used by a child process before the execvp: if there is a deadline it puts the process in the process
+group of the pipeline, so that the signals reach also its children.
+The first process also takes the terminal, so that the commands that read it are not stopped by SIGTTIN (the father
+does the same, whichever runs first).
+**************************************************************************************************************************/
+void deadlineChild()
+{
+	if (cur_deadline == 0)
+		return;
+	setpgid(0, pgid);	// the first process of the pipeline creates the group (pgid is 0)
+	if (pgid == 0)
+		giveTerminal(getpid());
+}
+
+
+/**************************************************************************************************************************
+Function to be used by the father after each fork.
+The father also calls setpgid, so the group exists before the next fork even if the child has not run yet, and after
+the first fork it gives the terminal to the group (the shell takes it back in waitPids).
+**************************************************************************************************************************/
+void deadlineForked(pid_t pid)
+{
+	if (cur_deadline == 0)
+		return;
+	if (pgid == 0) {
+		pgid = pid;
+		setpgid(pid, pgid);
+		tty_given = giveTerminal(pgid);
+		return;
+	}
+	setpgid(pid, pgid);
+}
+
+
+/**************************************************************************************************************************
+Function that sets the timerfd to expire after ns nanoseconds.
+**************************************************************************************************************************/
+static void armTimer(int tfd, long long ns)
+{
+	struct itimerspec t;
+	memset(&t, 0, sizeof(t));
+	t.it_value.tv_sec = ns / 1000000000LL;
+	t.it_value.tv_nsec = ns % 1000000000LL;
+	if (t.it_value.tv_sec == 0 && t.it_value.tv_nsec == 0)	// 0 would disarm the timer
+		t.it_value.tv_nsec = 1;
+	timerfd_settime(tfd, 0, &t, NULL);
+}
+
+
+/**************************************************************************************************************************
+Function that gives the terminal back to the shell, if it had been given to the pipeline.
+**************************************************************************************************************************/
+static void takeTerminal()
+{
+	if (tty_given)
+		giveTerminal(getpgrp());
+	tty_given = 0;
+}
+
+
+/**************************************************************************************************************************
+Function that reaps a process of the pipeline and writes it in the trace.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+static unsigned int reap(pid_t pid, int *status)
+{
+	while (waitpid(pid, status, 0) == -1)
+		if (errno != EINTR)
+			return 0;
+	traceEvent(EV_WAIT, 0, pid, NULL, 0, *status);
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that reaps, without blocking, the processes of the pipeline that have no pidfd and have terminated.
+It returns how many processes it has reaped.
+**************************************************************************************************************************/
+static unsigned int reapTerminated(pid_t * pids, int *status, const int *pidfds, unsigned char *reaped, unsigned int n)
+{
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < n; i++)
+		if (pidfds[i] == -1 && !reaped[i] && waitpid(pids[i], &status[i], WNOHANG) > 0) {
+			traceEvent(EV_WAIT, 0, pids[i], NULL, 0, status[i]);
+			reaped[i] = 1;
+			count++;
+		}
+	return count;
+}
+
+
+/**************************************************************************************************************************
+Function that waits for the n processes of the pipeline and saves the status of each of them in the same position.
+If there is a deadline it waits on the pidfd of the processes and on a timerfd with epoll: when the deadline expires it
+sends SIGTERM to the process group and SIGKILL after the grace period; the status of these processes becomes
+TIMEOUT_STATUS. The processes without pidfd (Linux < 5.3) are waited with SIGCHLD, read from a signalfd in the same
+epoll; if neither can be used the deadline is not applied and the shell says it. At the end the shell takes back the
+terminal.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int waitPids(pid_t * pids, int *status, unsigned int n)
+{
+	struct epoll_event ev, events[MAXEVENTS];
+	int ep, tfd, sfd = -1, *pidfds, k;
+	unsigned int i, remaining = n, no_pidfd = 0, phase = 0, ok = 1;	// phase: 0 before the deadline, 1 after SIGTERM, 2 after SIGKILL
+	unsigned char *timed_out, *reaped;
+	sigset_t chld, old_mask;
+	ep = tfd = -1;
+	if (cur_deadline == 0 || pgid == 0 || (ep = epoll_create1(EPOLL_CLOEXEC)) == -1
+	    || (tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1) {	// without deadline I simply wait for each process
+		if (ep != -1)
+			close(ep);
+		if (cur_deadline != 0 && pgid != 0)
+			fprintf(stdout, RED "*** Impossibile attendere i processi: il timeout non viene applicato ***" RESET_COLOR "\n");
+		for (i = 0; i < n; i++)
+			if (!reap(pids[i], &status[i]))
+				ok = 0;
+		takeTerminal();
+		return ok;
+	}
+	pidfds = malloc(sizeof(int) * n);
+	timed_out = calloc(n, 1);
+	reaped = calloc(n, 1);
+	ev.events = EPOLLIN;
+	for (i = 0; i < n; i++) {
+		ev.data.u32 = i;
+		pidfds[i] = syscall(SYS_pidfd_open, pids[i], 0);	// the pidfd becomes readable when the process terminates
+		if (pidfds[i] == -1 || epoll_ctl(ep, EPOLL_CTL_ADD, pidfds[i], &ev) == -1) {	// without pidfd: SIGCHLD
+			if (pidfds[i] != -1)
+				close(pidfds[i]);
+			pidfds[i] = -1;
+			no_pidfd++;
+		}
+	}
+	if (no_pidfd > 0) {	// SIGCHLD is blocked and read from the signalfd, then the processes are reaped with WNOHANG
+		sigemptyset(&chld);
+		sigaddset(&chld, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &chld, &old_mask);
+		ev.data.u32 = n + 1;
+		if ((sfd = signalfd(-1, &chld, SFD_CLOEXEC | SFD_NONBLOCK)) == -1 || epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev) == -1) {
+			fprintf(stdout, RED "*** Impossibile attendere i processi: il timeout non viene applicato ***" RESET_COLOR "\n");
+			remaining -= no_pidfd;	// they are waited at the end, without deadline
+		} else	// the processes that have terminated before the signalfd don't send other SIGCHLD
+			remaining -= reapTerminated(pids, status, pidfds, reaped, n);
+	}
+	ev.data.u32 = n;
+	epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev);
+	armTimer(tfd, cur_deadline);
+	while (remaining > 0) {
+		if ((k = epoll_wait(ep, events, MAXEVENTS, -1)) == -1) {
+			if (errno == EINTR)
+				continue;
+			ok = 0;
+			break;
+		}
+		for (int e = 0; e < k; e++) {
+			i = events[e].data.u32;
+			if (i == n) {	// the timer has expired
+				uint64_t expirations;
+				if (read(tfd, &expirations, sizeof(expirations)) == -1)
+					continue;
+				if (phase == 0) {
+					for (unsigned int s = 0; s < n; s++)
+						if (!reaped[s])
+							timed_out[s] = 1;
+					kill(-pgid, SIGTERM);
+					armTimer(tfd, cur_grace);
+				} else if (phase == 1) {
+					kill(-pgid, SIGKILL);
+				}
+				phase++;
+				continue;
+			}
+			if (i == n + 1) {	// SIGCHLD: some process without pidfd can have terminated
+				struct signalfd_siginfo info;
+				while (read(sfd, &info, sizeof(info)) > 0);
+				remaining -= reapTerminated(pids, status, pidfds, reaped, n);
+				continue;
+			}
+			epoll_ctl(ep, EPOLL_CTL_DEL, pidfds[i], NULL);
+			close(pidfds[i]);
+			pidfds[i] = -1;
+			remaining--;
+			reaped[i] = 1;
+			if (!reap(pids[i], &status[i]))
+				ok = 0;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		if (pidfds[i] != -1) {	// processes still to be reaped (error of epoll_wait or no pidfd)
+			close(pidfds[i]);
+			pidfds[i] = -1;
+		}
+		if (!reaped[i] && !reap(pids[i], &status[i]))
+			ok = 0;
+		if (timed_out[i]) {
+			fprintf(stdout, LIGHT_BLUE "Il processo con pid %d è stato terminato per timeout" RESET_COLOR "\n", pids[i]);
+			status[i] = TIMEOUT_STATUS << 8;	// as if it had done exit(TIMEOUT_STATUS)
+		}
+	}
+	if (no_pidfd > 0) {
+		if (sfd != -1)
+			close(sfd);
+		sigprocmask(SIG_SETMASK, &old_mask, NULL);
+	}
+	free(reaped);
+	free(timed_out);
+	free(pidfds);
+	close(tfd);
+	close(ep);
+	takeTerminal();
+	return ok;
+}
+
+
+/**************************************************************************************************************************
+Function to be used at the end of the command line: it forgets the deadline and the process group.
+**************************************************************************************************************************/
+void deadlineEnd()
+{
+	cur_deadline = 0;
+	cur_grace = DEADLINE_GRACE;
+	pgid = 0;
+	takeTerminal();	// if the pipeline has not been waited (for example after an error of fork)
+}
@@ -0,0 +1,39 @@
+#define DEADLINE_GRACE 2000000000LL	// time (in nanoseconds) between the SIGTERM and the SIGKILL if there is no "-k"
+#define TIMEOUT_STATUS 124	// exit status of the processes terminated because of the timeout (like timeout(1))
+
+
+/**************************************************************************************************************************
+Function that reads the "timeout [-k GRACE] DURATION" prefix at the beginning of the queue and removes it from the queue.
+Without prefix the deadline of the shell is used ("set -o deadline=...").
+It returns 0 if some error occurred, otherwise it returns 1 (also when there is no prefix).
+**************************************************************************************************************************/
+unsigned int deadlineBegin(queue *);
+
+
+/**************************************************************************************************************************
+Function to be used by a child process before the execvp: if there is a deadline it puts the process in the process
+group of the pipeline, so that the signals reach also its children. The first process also takes the terminal.
+**************************************************************************************************************************/
+void deadlineChild();
+
+
+/**************************************************************************************************************************
+Function to be used by the father after each fork (after the first one it gives the terminal to the pipeline).
+**************************************************************************************************************************/
+void deadlineForked(pid_t);
+
+
+/**************************************************************************************************************************
+Function that waits for the n processes of the pipeline and saves the status of each of them in the same position.
+If there is a deadline it waits on the pidfd of the processes and on a timerfd with epoll: when the deadline expires it
+sends SIGTERM to the process group and SIGKILL after the grace period; the status of these processes becomes
+TIMEOUT_STATUS. At the end the shell takes back the terminal.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int waitPids(pid_t *, int *, unsigned int);
+
+
+/**************************************************************************************************************************
+Function to be used at the end of the command line: it forgets the deadline and the process group.
+**************************************************************************************************************************/
+void deadlineEnd();
@@ -0,0 +1,480 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "filters.h"
+
+static char *obuf;	// buffer of the standard output
+static size_t olen = 0;
+static unsigned int closed = 0;	// 1 if the standard output can't be written anymore
+
+
+/**************************************************************************************************************************
+Functions that count the '\n' in a buffer: with AVX2 (32 bytes at a time), with SSE2 (16 bytes, always present on
+x86-64) or one byte at a time on the other architectures.
+The comparisons are summed in counters of one byte (at most 255 times) and then added with psadbw.
+**************************************************************************************************************************/
+static size_t countScalar(const char *p, size_t n)
+{
+	size_t c = 0;
+	for (size_t i = 0; i < n; i++)
+		c += p[i] == '\n';
+	return c;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static size_t countAvx2(const char *p, size_t n)
+{
+	const __m256i nl = _mm256_set1_epi8('\n'), zero = _mm256_setzero_si256();
+	__m256i acc = zero;
+	size_t i = 0, c;
+	while (n - i >= 32) {
+		__m256i bytes = zero;
+		for (size_t k = 0; k < 255 && n - i >= 32; k++, i += 32)
+			bytes = _mm256_sub_epi8(bytes, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), nl));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, zero));
+	}
+	c = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+	return c + countScalar(p + i, n - i);
+}
+
+static size_t countSse2(const char *p, size_t n)
+{
+	const __m128i nl = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	size_t i = 0, c;
+	while (n - i >= 16) {
+		__m128i bytes = zero;
+		for (size_t k = 0; k < 255 && n - i >= 16; k++, i += 16)
+			bytes = _mm_sub_epi8(bytes, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(bytes, zero));
+	}
+	c = _mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+	return c + countScalar(p + i, n - i);
+}
+#endif
+
+static size_t (*countNewlines)(const char *, size_t) = countScalar;	// chosen by runFilters for the processor
+
+
+/**************************************************************************************************************************
+Function that reads a number without sign. It returns -1 if the string is not a number.
+**************************************************************************************************************************/
+static long long number(const char *s)
+{
+	char *end;
+	long long n;
+	if (!isdigit((unsigned char)*s))
+		return -1;
+	n = strtoll(s, &end, 10);
+	return *end == '\0' ? n : -1;
+}
+
+
+/**************************************************************************************************************************
+Function that reads the list of fields of "cut -f" ("1,3-5,7-"). It returns 0 if it is not correct.
+**************************************************************************************************************************/
+static unsigned int parseFields(filter * f, const char *arg)
+{
+	char *list = strdup(arg), *save, *range;	// the argument is not changed: the filter is read again by the child
+	memset(f->fields, 0, sizeof(f->fields));
+	f->from = f->max_field = 0;
+	for (char *l = list; (range = strtok_r(l, ",", &save)) != NULL; l = NULL) {
+		char *dash = strchr(range, '-');
+		long long a, b;
+		if (dash == NULL) {
+			a = b = number(range);
+		} else {
+			*dash = '\0';
+			a = dash == range ? 1 : number(range);
+			b = dash[1] == '\0' ? 0 : number(dash + 1);	// 0: up to the last field
+		}
+		if (a < 1 || b < 0 || a > MAXFIELDS || b > MAXFIELDS || (b != 0 && b < a)) {
+			free(list);
+			return 0;
+		}
+		if (b == 0) {
+			f->from = f->from == 0 || a < f->from ? a : f->from;
+			b = MAXFIELDS;
+		}
+		for (long long i = a; i <= b; i++)
+			f->fields[i] = 1;
+		if (b > f->max_field)
+			f->max_field = b;
+	}
+	free(list);
+	return f->max_field > 0;
+}
+
+
+/**************************************************************************************************************************
+Function that returns 1 if the command is a builtin filter with options that it supports (the filters read only the
+standard input), and fills the filter; otherwise it returns 0 and the command is executed with execvp.
+**************************************************************************************************************************/
+unsigned int parseFilter(char **arg, unsigned int num_arg, filter * f)
+{
+	unsigned int i = 1, fixed = 0;
+	memset(f, 0, sizeof(filter));
+	if (strcmp(arg[0], "grep") == 0 || strcmp(arg[0], "fgrep") == 0) {	// grep -F [-v] [-c] PATTERN
+		f->type = F_GREP;
+		fixed = arg[0][0] == 'f';
+		for (; i < num_arg && arg[i][0] == '-' && arg[i][1] != '\0'; i++)
+			for (char *o = arg[i] + 1; *o; o++)
+				if (*o == 'F')
+					fixed = 1;
+				else if (*o == 'v')
+					f->invert = 1;
+				else if (*o == 'c')
+					f->count = 1;
+				else
+					return 0;
+		if (!fixed || i + 1 != num_arg)	// only fixed strings and only the standard input
+			return 0;
+		f->pattern = arg[i];
+		f->pattern_len = strlen(arg[i]);
+		return 1;
+	}
+	if (strcmp(arg[0], "cut") == 0) {	// cut -f LIST [-d C] [-s]
+		char *list = NULL;
+		f->type = F_CUT;
+		f->delim = '\t';
+		for (; i < num_arg; i++) {
+			if (strncmp(arg[i], "-d", 2) == 0) {
+				char *d = arg[i][2] != '\0' ? arg[i] + 2 : i + 1 < num_arg ? arg[++i] : "";
+				if (strlen(d) != 1)
+					return 0;
+				f->delim = d[0];
+			} else if (strncmp(arg[i], "-f", 2) == 0) {
+				list = arg[i][2] != '\0' ? arg[i] + 2 : i + 1 < num_arg ? arg[++i] : NULL;
+			} else if (strcmp(arg[i], "-s") == 0) {
+				f->only_delimited = 1;
+			} else {
+				return 0;
+			}
+		}
+		return list != NULL && parseFields(f, list);
+	}
+	if (strcmp(arg[0], "wc") == 0) {	// wc [-l] [-w] [-c]
+		f->type = F_WC;
+		for (; i < num_arg; i++) {
+			if (arg[i][0] != '-' || arg[i][1] == '\0')
+				return 0;
+			for (char *o = arg[i] + 1; *o; o++)
+				if (*o == 'l')
+					f->flags |= WC_LINES;
+				else if (*o == 'w')
+					f->flags |= WC_WORDS;
+				else if (*o == 'c')
+					f->flags |= WC_BYTES;
+				else
+					return 0;
+		}
+		if (f->flags == 0)
+			f->flags = WC_LINES | WC_WORDS | WC_BYTES;
+		return 1;
+	}
+	if (strcmp(arg[0], "head") == 0) {	// head [-n N | -nN | -N]
+		long long n = 10;
+		f->type = F_HEAD;
+		if (num_arg == 2 && strncmp(arg[1], "-n", 2) == 0 && arg[1][2] != '\0')
+			n = number(arg[1] + 2);
+		else if (num_arg == 2 && arg[1][0] == '-')
+			n = number(arg[1] + 1);
+		else if (num_arg == 3 && strcmp(arg[1], "-n") == 0)
+			n = number(arg[2]);
+		else if (num_arg != 1)
+			return 0;
+		f->n = n;
+		return n >= 0;
+	}
+	return 0;
+}
+
+
+/**************************************************************************************************************************
+Function that writes the output buffer in the standard output.
+**************************************************************************************************************************/
+static void flushOutput()
+{
+	for (char *p = obuf; olen > 0 && !closed;) {
+		ssize_t w = write(STDOUT_FILENO, p, olen);
+		if (w == -1 && errno == EINTR)
+			continue;
+		if (w == -1) {	// the reader has closed the pipe
+			closed = 1;
+			break;
+		}
+		p += w;
+		olen -= w;
+	}
+	olen = 0;
+}
+
+
+/**************************************************************************************************************************
+Function that appends a line (with the '\n' if nl is 1) to the output buffer.
+**************************************************************************************************************************/
+static void emit(const char *line, size_t len, unsigned int nl)
+{
+	if (olen + len + 1 > FILTER_BUF)
+		flushOutput();
+	if (len + 1 > FILTER_BUF) {	// line longer than the buffer: it is written directly
+		olen = 0;
+		for (size_t w = 0; w < len && !closed;) {
+			ssize_t r = write(STDOUT_FILENO, line + w, len - w);
+			if (r == -1 && errno != EINTR)
+				closed = 1;
+			w += r > 0 ? r : 0;
+		}
+		len = 0;
+	}
+	memcpy(obuf + olen, line, len);
+	olen += len;
+	if (nl)
+		obuf[olen++] = '\n';
+}
+
+
+/**************************************************************************************************************************
+Function that counts the words of a piece of text for "wc -w"; in_word remains between two pieces.
+**************************************************************************************************************************/
+static void countWords(filter * f, const char *p, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = p[i];
+		unsigned int space = c == ' ' || (c >= '\t' && c <= '\r');
+		f->words += !space && !f->in_word;
+		f->in_word = !space;
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that cuts the fields of a line in the buffer of the filter.
+It returns NULL if the line must not be written ("-s" and line without delimiter).
+**************************************************************************************************************************/
+static const char *cutLine(filter * f, const char *line, size_t len, size_t *out_len)
+{
+	const char *p = line, *end = line + len, *d;
+	unsigned int field = 1, first = 1;
+	size_t o = 0;
+	if ((d = memchr(line, f->delim, len)) == NULL) {	// line without delimiter: it is written as it is
+		*out_len = len;
+		return f->only_delimited ? NULL : line;
+	}
+	if (f->out_dim < len) {
+		f->out = realloc(f->out, len);
+		f->out_dim = len;
+	}
+	while (1) {
+		size_t flen = (d != NULL ? d : end) - p;
+		if ((field <= MAXFIELDS && f->fields[field]) || (f->from != 0 && field >= f->from)) {
+			if (!first)
+				f->out[o++] = f->delim;
+			memcpy(f->out + o, p, flen);
+			o += flen;
+			first = 0;
+		}
+		if (d == NULL || (f->from == 0 && field >= f->max_field))	// there are no more fields to write
+			break;
+		p = d + 1;
+		field++;
+		d = memchr(p, f->delim, end - p);
+	}
+	*out_len = o;
+	return f->out;
+}
+
+
+/**************************************************************************************************************************
+Function that passes a line (without '\n', nl is 1 if it had one) to the filters from k to n-1 and writes it if it
+passes all of them.
+It returns 0 if no more lines are needed (a "head" has written all its lines or the output has been closed): the line
+that completes a "head" still goes to the next filters, so that "head -n 1" doesn't wait for a second line.
+**************************************************************************************************************************/
+static unsigned int pushLine(filter * f, unsigned int n, unsigned int k, const char *line, size_t len, unsigned int nl)
+{
+	unsigned int more = 1;
+	for (; k < n; k++) {
+		filter *c = &f[k];
+		switch (c->type) {
+		case F_GREP:
+			if ((memmem(line, len, c->pattern, c->pattern_len) != NULL) == c->invert)
+				return more;
+			c->lines++;
+			if (c->count)
+				return more;
+			nl = 1;
+			break;
+		case F_CUT:
+			if ((line = cutLine(c, line, len, &len)) == NULL)
+				return more;
+			nl = 1;
+			break;
+		case F_WC:
+			c->lines += nl;
+			c->bytes += len + nl;
+			if (c->flags & WC_WORDS) {
+				countWords(c, line, len);
+				c->in_word = c->in_word && !nl;
+			}
+			return more;
+		case F_HEAD:
+			if (c->lines == c->n)
+				return 0;
+			if (++c->lines == c->n)
+				more = 0;
+			break;
+		}
+	}
+	emit(line, len, nl);
+	return more && !closed;
+}
+
+
+/**************************************************************************************************************************
+Function that passes the lines of buf to the filters. If eof is 0 the last line without '\n' is left in the buffer.
+It saves in *used the bytes used and returns 0 if no more lines are needed.
+When the first filter is "grep -F" without "-v" the pattern is searched in the whole buffer with memmem, and only the
+lines where it is found are split.
+**************************************************************************************************************************/
+static unsigned int processLines(filter * f, unsigned int n, const char *buf, size_t len, unsigned int eof, size_t *used)
+{
+	const char *p = buf, *end = buf + len, *q, *m = NULL;
+	unsigned int more = 1;
+	if (f[0].type == F_GREP && !f[0].invert && f[0].pattern_len > 0) {
+		while (more && (m = memmem(p, end - p, f[0].pattern, f[0].pattern_len)) != NULL) {
+			const char *start = memrchr(p, '\n', m - p);
+			start = start == NULL ? p : start + 1;
+			if ((q = memchr(m, '\n', end - m)) == NULL && !eof) {	// the line is not complete yet
+				p = start;
+				break;
+			}
+			f[0].lines++;
+			if (!f[0].count)
+				more = pushLine(f, n, 1, start, (q != NULL ? q : end) - start, 1);
+			p = q != NULL ? q + 1 : end;
+		}
+		if (m == NULL && !eof && (q = memrchr(p, '\n', end - p)) != NULL)	// the incomplete line can still contain it
+			p = q + 1;
+		else if (m == NULL)
+			p = eof ? end : p;
+		*used = p - buf;
+		return more;
+	}
+	while (more && p < end) {
+		if ((q = memchr(p, '\n', end - p)) == NULL) {
+			if (!eof)
+				break;
+			more = pushLine(f, n, 0, p, end - p, 0);
+			p = end;
+			break;
+		}
+		more = pushLine(f, n, 0, p, q - p, 1);
+		p = q + 1;
+	}
+	*used = p - buf;
+	return more;
+}
+
+
+/**************************************************************************************************************************
+Function that writes the result of the filters that write only at the end ("wc" and "grep -c") to the next filters.
+With more counters "wc" writes them in columns like coreutils: as wide as the size of the input if the first filter reads
+a regular file, otherwise of 7 characters.
+**************************************************************************************************************************/
+static void finishFilters(filter * f, unsigned int n)
+{
+	char line[80];
+	struct stat st;
+	for (unsigned int k = 0; k < n; k++) {
+		int len = -1, width = 7;
+		if (k == 0 && fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode))
+			width = snprintf(NULL, 0, "%lld", (long long)st.st_size);
+		if (f[k].type == F_GREP && f[k].count)
+			len = sprintf(line, "%llu", f[k].lines);
+		else if (f[k].type == F_WC && (f[k].flags == WC_LINES || f[k].flags == WC_WORDS || f[k].flags == WC_BYTES))
+			len = sprintf(line, "%llu", f[k].flags == WC_LINES ? f[k].lines : f[k].flags == WC_WORDS ? f[k].words : f[k].bytes);
+		else if (f[k].type == F_WC) {	// more counters: like wc, in columns
+			len = 0;
+			if (f[k].flags & WC_LINES)
+				len += sprintf(line + len, "%*llu ", width, f[k].lines);
+			if (f[k].flags & WC_WORDS)
+				len += sprintf(line + len, "%*llu ", width, f[k].words);
+			if (f[k].flags & WC_BYTES)
+				len += sprintf(line + len, "%*llu ", width, f[k].bytes);
+			len--;	// without the last space
+		}
+		if (len >= 0)
+			pushLine(f, n, k + 1, line, len, 1);
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that executes the n filters, joined in the same process: the lines pass from a filter to the next one without
+pipes. It reads the standard input with large reads and writes the standard output with large writes.
+When the first filter is "wc" the lines are not split: the '\n' are counted with SSE2 or AVX2 (chosen at runtime).
+A "head -n 0" stops the filters before the first read.
+The exit status of each filter is saved in status (1 for a "grep" that has not selected any line, 2 for the first filter
+if the standard input can't be read, otherwise 0), so that the shell can give each filter its own status.
+It returns the exit status of the last filter.
+**************************************************************************************************************************/
+int runFilters(filter * f, unsigned int n, int *status)
+{
+	size_t cap = FILTER_BUF, len = 0, used;
+	char *buf = malloc(cap);
+	unsigned int eof = 0, more = 1, error = 0;
+#if defined(__x86_64__)
+	countNewlines = __builtin_cpu_supports("avx2") ? countAvx2 : countSse2;
+#endif
+	obuf = malloc(FILTER_BUF);
+	for (unsigned int k = 0; k < n; k++)
+		if (f[k].type == F_HEAD && f[k].n == 0)
+			more = 0;
+	while (more && !eof) {
+		ssize_t r = read(STDIN_FILENO, buf + len, cap - len);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r == -1) {
+			perror("Errore in lettura\n");
+			error = 1;
+		}
+		if (r <= 0)
+			eof = 1;
+		else
+			len += r;
+		if (f[0].type == F_WC) {	// the whole buffer is counted, there is no need of the lines
+			f[0].lines += countNewlines(buf, len);
+			f[0].bytes += len;
+			if (f[0].flags & WC_WORDS)
+				countWords(&f[0], buf, len);
+			len = 0;
+			continue;
+		}
+		more = processLines(f, n, buf, len, eof, &used);
+		memmove(buf, buf + used, len - used);	// the incomplete line goes at the beginning
+		len -= used;
+		if (len == cap)	// a line longer than the buffer
+			buf = realloc(buf, cap *= 2);
+	}
+	finishFilters(f, n);
+	flushOutput();
+	free(buf);
+	free(obuf);
+	for (unsigned int k = 0; k < n; k++)
+		status[k] = f[k].type == F_GREP && f[k].lines == 0;
+	if (error)	// the first filter is the one that reads the standard input
+		status[0] = 2;
+	return status[n - 1];
+}
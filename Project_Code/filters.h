@@ -0,0 +1,53 @@
+#define FILTER_BUF (1 << 20)	// dimension of the buffers of input and output of the filters (they grow for longer lines)
+#define MAXFIELDS 1024	// maximum field of "cut -f" that can be written as a single number (also "N-" is accepted)
+#define WC_LINES 1	// flags of "wc": -l, -w and -c
+#define WC_WORDS 2
+#define WC_BYTES 4
+
+
+/**************************************************************************************************************************
+Types of the builtin filters: "grep -F", "cut -f", "wc" and "head".
+**************************************************************************************************************************/
+typedef enum {
+	F_GREP,
+	F_CUT,
+	F_WC,
+	F_HEAD
+} filter_type;
+
+
+/**************************************************************************************************************************
+Filter Struct: a filter of a pipeline with its options and its counters.
+grep: pattern (pattern_len characters), invert (-v), count (-c); lines are the lines selected.
+cut: delim (-d), fields (-f, fields[i] is 1 if the field i is selected, from is the beginning of "N-" or 0), only_delimited
+(-s), out is the buffer of the line that is being cut.
+wc: flags (WC_LINES, WC_WORDS and WC_BYTES), lines, words, bytes and in_word between the buffers.
+head: n lines, lines are the lines already written.
+**************************************************************************************************************************/
+typedef struct {
+	filter_type type;
+	const char *pattern;
+	size_t pattern_len, out_dim;
+	unsigned int invert, count, only_delimited, flags, from, max_field, in_word;
+	char delim, *out;
+	unsigned char fields[MAXFIELDS + 1];
+	unsigned long long n, lines, words, bytes;
+} filter;
+
+
+/**************************************************************************************************************************
+Function that returns 1 if the command is a builtin filter with options that it supports (the filters read only the
+standard input), and fills the filter; otherwise it returns 0 and the command is executed with execvp.
+**************************************************************************************************************************/
+unsigned int parseFilter(char **, unsigned int, filter *);
+
+
+/**************************************************************************************************************************
+Function that executes the n filters, joined in the same process: the lines pass from a filter to the next one without
+pipes. It reads the standard input with large reads and writes the standard output with large writes.
+A "head -n 0" stops the filters before the first read.
+The exit status of each filter is saved in status (1 for a "grep" that has not selected any line, 2 for the first filter
+if the standard input can't be read, otherwise 0), so that the shell can give each filter its own status.
+It returns the exit status of the last filter.
+**************************************************************************************************************************/
+int runFilters(filter *, unsigned int, int *);
@@ -0,0 +1,96 @@
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include "parsing.h"
+#include "options.h"
+
+options opts = { 0 };
+
+
+/**************************************************************************************************************************
+Function that converts a duration like "10", "1.5s", "500ms", "2m" or "1h" (seconds without suffix) into nanoseconds.
+It returns -1 if the duration is not correct (also infinite, NaN or too long for a long long of nanoseconds).
+**************************************************************************************************************************/
+long long parseDuration(const char *s)
+{
+	char *end;
+	double value = strtod(s, &end), scale;
+	if (end == s || !isfinite(value) || value < 0)
+		return -1;
+	if (strcmp(end, "") == 0 || strcmp(end, "s") == 0)
+		scale = 1e9;
+	else if (strcmp(end, "ms") == 0)
+		scale = 1e6;
+	else if (strcmp(end, "m") == 0)
+		scale = 60e9;
+	else if (strcmp(end, "h") == 0)
+		scale = 3600e9;
+	else
+		return -1;
+	if (value >= LLONG_MAX / scale)	// the conversion would overflow
+		return -1;
+	return value * scale;
+}
+
+
+/**************************************************************************************************************************
+Function that prints the options of the shell.
+**************************************************************************************************************************/
+static void printOptions()
+{
+	if (opts.deadline > 0)
+		fprintf(stdout, "deadline\t%.3fs\n", opts.deadline / 1e9);
+	else
+		fprintf(stdout, "deadline\toff\n");
+	fprintf(stdout, "pipemeter\t%s\n", opts.pipemeter ? "on" : "off");
+	fprintf(stdout, "pipefail\t%s\n", opts.pipefail ? "on" : "off");
+	fprintf(stdout, "errexit\t\t%s\n", opts.errexit ? "on" : "off");
+}
+
+
+/**************************************************************************************************************************
+Function for executing the "set" command: "set -o" prints the options, "set -o name=value" or "set -o name" changes an
+option, "set +o name" disables it and "set -e" / "set +e" is the same as "set -o errexit" / "set +o errexit".
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int set(char **arg, unsigned int num_arg)
+{
+	char *value;
+	if (num_arg == 1 || (num_arg == 2 && strcmp(arg[1], "-o") == 0)) {
+		printOptions();
+		return 1;
+	}
+	if (num_arg == 2 && (strcmp(arg[1], "-e") == 0 || strcmp(arg[1], "+e") == 0)) {
+		opts.errexit = arg[1][0] == '-';
+		return 1;
+	}
+	if (num_arg != 3 || (strcmp(arg[1], "-o") != 0 && strcmp(arg[1], "+o") != 0)) {
+		fprintf(stdout, RED "micro-bash: set: uso: set [-o nome[=valore] | +o nome | -e | +e]" RESET_COLOR "\n");
+		return 0;
+	}
+	if ((value = strchr(arg[2], '=')) != NULL)
+		*value++ = '\0';
+	if (strcmp(arg[2], "deadline") == 0) {
+		long long deadline = 0;
+		if (arg[1][0] == '-' && (value == NULL || (deadline = parseDuration(value)) < 0)) {
+			fprintf(stdout, RED "micro-bash: set: deadline: durata non valida" RESET_COLOR "\n");
+			return 0;
+		}
+		opts.deadline = deadline;
+		return 1;
+	}
+	if (strcmp(arg[2], "pipemeter") == 0 && value == NULL) {
+		opts.pipemeter = arg[1][0] == '-';
+		return 1;
+	}
+	if (strcmp(arg[2], "pipefail") == 0 && value == NULL) {
+		opts.pipefail = arg[1][0] == '-';
+		return 1;
+	}
+	if (strcmp(arg[2], "errexit") == 0 && value == NULL) {
+		opts.errexit = arg[1][0] == '-';
+		return 1;
+	}
+	fprintf(stdout, RED "micro-bash: set: %s: opzione non valida" RESET_COLOR "\n", arg[2]);
+	return 0;
+}
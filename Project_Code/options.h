@@ -0,0 +1,32 @@
+/**************************************************************************************************************************
+Struct with the options of the shell changed with "set -o".
+deadline is the maximum time (in nanoseconds) of every command line, 0 if there is no deadline.
+pipemeter is 1 if all the pipes have a meter, as if they were written "|:".
+pipefail is 1 if the status of a pipeline is the last one that is not 0, errexit is 1 if the shell ends at the first
+command line that fails ("set -e").
+**************************************************************************************************************************/
+typedef struct {
+	long long deadline;
+	unsigned int pipemeter, pipefail, errexit;
+} options;
+
+
+/**************************************************************************************************************************
+Options of the shell.
+**************************************************************************************************************************/
+extern options opts;
+
+
+/**************************************************************************************************************************
+Function that converts a duration like "10", "1.5s", "500ms", "2m" or "1h" (seconds without suffix) into nanoseconds.
+It returns -1 if the duration is not correct (also infinite, NaN or too long for a long long of nanoseconds).
+**************************************************************************************************************************/
+long long parseDuration(const char *);
+
+
+/**************************************************************************************************************************
+Function for executing the "set" command: "set -o" prints the options, "set -o name=value" or "set -o name" changes an
+option, "set +o name" disables it and "set -e" / "set +e" is the same as "set -o errexit" / "set +o errexit".
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int set(char **, unsigned int);
@@ -6,30 +6,40 @@
 #include <ctype.h>
 #include <fcntl.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include "parsing.h"
-
-
-/**************************************************************************************************************************
-Function for printing the current directory.
-**************************************************************************************************************************/
-void printCurDir()
-{
-	char *dir = NULL;
-	fprintf(stdout, GREEN "%s" RESET_COLOR "$ ", (dir = get_current_dir_name()));
-	free(dir);
-}
+#include "trace.h"
+#include "rlimits.h"
+#include "options.h"
+#include "deadline.h"
+#include "relay.h"
+#include "xargs.h"
+#include "prompt.h"
+#include "status.h"
+#include "coproc.h"
+#include "filters.h"
 
 
 /**************************************************************************************************************************
 Function that takes the input and checks the ctrl+D at the beginning of the line.
+A line too long is thrown away and becomes an empty line.
 Returns 0 if a ctrl + D was found or the input was not successful.
 **************************************************************************************************************************/
 unsigned int inputCommand(char *s)
 {
+	size_t len;
+	int c;
 	if (fgets(s, MAXCOMM, stdin) == NULL) {	// command input
 		fprintf(stdout, "^D\n");	// ctrl+D to exit micro-bash
 		return 0;
 	}
+	len = strlen(s);
+	if (len == MAXCOMM - 1 && s[len - 1] != '\n') {	// line too long: I throw away the rest, so it isn't a new command
+		while ((c = getchar()) != EOF && c != '\n');
+		fprintf(stdout, RED "micro-bash: comando troppo lungo (massimo %d caratteri)" RESET_COLOR "\n", MAXCOMM - 2);
+		s[0] = '\n';
+		s[1] = '\0';
+	}
 	return 1;
 }
 
@@ -41,8 +51,11 @@ It returns NULL if some error has occurred, otherwise it returns the correct env
 char *environmentVar(char *arg_token)
 {
 	unsigned int i;
+	char *value;
 	for (i = 0; i < strlen(arg_token); i++)
 		arg_token[i] = toupper(arg_token[i]);	// capitalizes the environment variable (e.g.: $home = $HOME)
+	if ((value = statusVar(arg_token + 1)) != NULL)	// $?, $PIPESTATUS and $PIPESTATUS[i] are variables of the shell
+		return value;
 	if ((arg_token = getenv(arg_token + 1)) == NULL){	// I insert the corresponding environment variable in the arguments
 		fprintf(stdout, RED "*** Variabile d'ambiente non esistente ***" RESET_COLOR "\n");
 		return NULL;
@@ -63,68 +76,254 @@ unsigned int cd(char *dir, unsigned int num_arg)	// 0 if error; 1 if correct
 	} else if (num_arg == 1) {	// if you just write "cd" with no other arguments
 		if (chdir(getenv("HOME")) == -1)
 			fprintf(stdout, RED "micro-bash: cd: %s: File o directory non esistente" RESET_COLOR "\n", dir);
+		else
+			promptChdir();
 		return 1;
 	}
 	if (strcmp(dir, "-") == 0 || strcmp(dir, "~") == 0) {	// if you write "cd -" or "cd ~"
 		if (chdir(getenv("HOME")) == -1)
 			fprintf(stdout, RED "micro-bash: cd: %s: File o directory non esistente" RESET_COLOR "\n", dir);
+		else
+			promptChdir();
 		return 1;
 	}
 	if (chdir(dir) == -1) {
 		fprintf(stdout, RED "micro-bash: cd: %s: File o directory non esistente" RESET_COLOR "\n", dir);
 		return 0;
 	}
+	promptChdir();	// the directory saved for the prompt changes only here
 	return 1;
 }
 
 
 /**************************************************************************************************************************
-Function for the execution of a single command, therefore without pipes.
-It returns 0 if some error occurred, otherwise it returns 1.
+Function that prepares a child process of a pipeline: limits and process group for the deadline.
+The exec event of the trace is written only just before the execvp, because the builtins and the relays don't do it.
 **************************************************************************************************************************/
-unsigned int execSingleCommand(char **arg_token, int num_arg, int fd_in, int fd_out)
+void prepareChild()
 {
-	pid_t child_pid;
-	arg_token = (char **)realloc(arg_token, sizeof(char *) * (num_arg + 1));
-	arg_token[num_arg] = NULL;
-	if ((child_pid = fork()) == -1)
+	limitsChild();
+	deadlineChild();
+}
+
+
+/**************************************************************************************************************************
+Function that returns 1 if the command is a builtin that can be a stage of a pipeline ("xargs" or a filter: "grep -F",
+"cut", "wc" and "head"), otherwise it returns 0.
+These commands are executed by the child process without the execvp.
+**************************************************************************************************************************/
+unsigned int isStageBuiltin(char **arg_token, unsigned int num_arg)
+{
+	filter f;
+	return strcmp(arg_token[0], "xargs") == 0 || parseFilter(arg_token, num_arg, &f);
+}
+
+
+/**************************************************************************************************************************
+Function that executes in the child process a builtin that can be a stage of a pipeline, or n filters joined together.
+The exit status of each of the n commands is saved in status.
+It returns the exit status of the last one.
+**************************************************************************************************************************/
+int runStageBuiltin(stage * stages, unsigned int n, int *status)
+{
+	filter *f;
+	if (strcmp(stages[0].argv[0], "xargs") == 0)
+		return status[0] = xargs(stages[0].argv, stages[0].argc);
+	f = malloc(sizeof(filter) * n);
+	for (unsigned int k = 0; k < n; k++)
+		parseFilter(stages[k].argv, stages[k].argc, &f[k]);
+	return runFilters(f, n, status);
+}
+
+
+/**************************************************************************************************************************
+Function that returns 1 if all the redirections of the command are of its standard output (">" and ">>") when output is
+1, or of its standard input ("<", "<<<" and "<<") when output is 0, otherwise it returns 0.
+**************************************************************************************************************************/
+unsigned int onlyRedirs(const stage * s, unsigned int output)
+{
+	redir r;
+	for (unsigned int k = 0; k < s->n_redirs; k++) {
+		if (!parseRedir(s->redirs[k], &r))
+			return 0;
+		if (output ? (r.type != R_OUT && r.type != R_APPEND) || r.fd != STDOUT_FILENO
+		    : (r.type != R_IN && r.type != R_HERESTRING && r.type != R_HEREDOC) || r.fd != STDIN_FILENO)
+			return 0;
+	}
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that returns 1 if the argument is a redirection (an optional number and then '<' or '>'), otherwise it returns 0.
+**************************************************************************************************************************/
+unsigned int isRedirection(const char *arg)
+{
+	while (isdigit((unsigned char)*arg))
+		arg++;
+	return *arg == '<' || *arg == '>';
+}
+
+
+/**************************************************************************************************************************
+Function that decomposes a redirection in type, file descriptor and target.
+It returns 0 if the redirection is not correct, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int parseRedir(char *arg, redir * r)
+{
+	char *p = arg;
+	long n = -1;
+	if (isdigit((unsigned char)*p))
+		n = strtol(p, &p, 10);
+	if (strncmp(p, "<<<", 3) == 0) {
+		r->type = R_HERESTRING;
+		p += 3;
+	} else if (strncmp(p, "<<", 2) == 0) {
+		r->type = R_HEREDOC;
+		p += 2;
+	} else if (strncmp(p, "<&", 2) == 0 || strncmp(p, ">&", 2) == 0) {
+		r->type = R_DUP;
+		p += 2;
+	} else if (strncmp(p, ">>", 2) == 0) {
+		r->type = R_APPEND;
+		p += 2;
+	} else {
+		r->type = *p == '<' ? R_IN : R_OUT;
+		p++;
+	}
+	if (n < 0)	// without number: 0 for the input, 1 for the output
+		n = arg[0] == '<' ? STDIN_FILENO : STDOUT_FILENO;
+	if (n > 255)	// like bash, bigger file descriptors are not accepted
+		return 0;
+	r->fd = n;
+	r->target = p;
+	if (*p == '\0')	// I have the ">" (or the "<") and then a space: that's not good
 		return 0;
-	if (child_pid == 0) {	// SON PROCESS
-		if (fd_in >= 0)
-			if (dup2(fd_in, STDIN_FILENO) == -1) {	// if I have an input redirect
-				perror("Errore in dup2 per reindirizzamento input\n");
+	if (r->type == R_DUP && isdigit((unsigned char)*p)) {	// the target of "n>&m" is a number
+		for (; *p; p++)
+			if (!isdigit((unsigned char)*p))
 				return 0;
-			}
-		if (fd_out >= 0)
-			if (dup2(fd_out, STDOUT_FILENO) == -1) {	// if I have an output redirect
-				perror("Errore in dup2 per reindirizzamento output\n");
+	} else if (r->type == R_DUP) {	// or the name of a coprocess
+		for (; *p; p++)
+			if (!isalnum((unsigned char)*p) && *p != '_')
 				return 0;
-			}
-		execvp(arg_token[0], arg_token);	// I execute the command
-		// if i get here the execvp has failed
-		fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-		exit(EXIT_FAILURE);
-	} else {
-		// FATHER PROCESS
-		if (wait(NULL) == -1) {
-			free(arg_token);
+	}
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Here-documents of the command line, in the order in which they have been read, and the next one to be used.
+**************************************************************************************************************************/
+int heredocs[MAXHEREDOC];
+unsigned int n_heredocs = 0, next_heredoc = 0;
+
+
+/**************************************************************************************************************************
+Function that seals a memfd (nobody can change it anymore) and brings it back to the beginning, ready to be read.
+It returns -1 if any errors occurred, otherwise returns the file descriptor.
+**************************************************************************************************************************/
+int sealMemfd(int fd)
+{
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+/**************************************************************************************************************************
+Function that reads the lines of a here-document up to the delimiter and saves them in a sealed memfd, so that the body
+doesn't go on the disk and doesn't need a process that writes it in a pipe.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int readHereDoc(const char *delimiter)
+{
+	char line[MAXCHARCOMM];
+	size_t len = strlen(delimiter);
+	int fd;
+	if (n_heredocs == MAXHEREDOC) {
+		fprintf(stdout, RED "micro-bash: troppi here-document" RESET_COLOR "\n");
+		return 0;
+	}
+	if ((fd = memfd_create("ubash-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1) {
+		perror("Errore in memfd_create\n");
+		return 0;
+	}
+	while (1) {
+		if (isatty(STDIN_FILENO)) {
+			fprintf(stdout, "> ");
+			fflush(stdout);
+		}
+		if (fgets(line, sizeof(line), stdin) == NULL) {	// ctrl+D before the delimiter: I keep what I have read
+			fprintf(stdout, LIGHT_BLUE "micro-bash: here-document delimitato da fine file (voluto \"%s\")" RESET_COLOR "\n", delimiter);
+			break;
+		}
+		if (strncmp(line, delimiter, len) == 0 && (line[len] == '\n' || line[len] == '\0'))
+			break;
+		if (write(fd, line, strlen(line)) == -1) {
+			perror("Errore in scrittura del here-document\n");
+			close(fd);
 			return 0;
 		}
-		free(arg_token);
 	}
+	if ((fd = sealMemfd(fd)) == -1)
+		return 0;
+	heredocs[n_heredocs++] = fd;
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that reads the bodies of the here-documents of the command line, in order.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int readHereDocs(queue * q)
+{
+	redir r;
+	for (int k = q->first; k < q->last; k++)
+		if (isRedirection(q->array[k]) && parseRedir(q->array[k], &r) && r.type == R_HEREDOC && !readHereDoc(r.target))
+			return 0;
 	return 1;
 }
 
 
 /**************************************************************************************************************************
-Function for input redirection.
+Function that closes the here-documents of the command line that have not been used.
+**************************************************************************************************************************/
+void closeHereDocs()
+{
+	for (; next_heredoc < n_heredocs; next_heredoc++)
+		close(heredocs[next_heredoc]);
+	n_heredocs = next_heredoc = 0;
+}
+
+
+/**************************************************************************************************************************
+Function for input redirection ("<file", "<<<word" or "<<DELIMITER").
 It returns -1 if any errors occurred, otherwise returns the file descriptor of the file.
 **************************************************************************************************************************/
-int openRedirInput(char *arg_token)
+int openRedirInput(char *arg_token, const redir * r)
 {
 	int fd_in = -2;
-	if ((fd_in = open(arg_token + 1, O_RDONLY)) < 0) {
-		fprintf(stdout, RED "micro-bash: %s: File o directory non esistente" RESET_COLOR "\n", arg_token + 1);
+	if (r->type == R_HEREDOC) {	// the body has already been read by the parser
+		fd_in = next_heredoc < n_heredocs ? heredocs[next_heredoc++] : -1;
+	} else if (r->type == R_HERESTRING) {	// the word and a '\n', in a sealed memfd
+		if ((fd_in = memfd_create("ubash-herestring", MFD_CLOEXEC | MFD_ALLOW_SEALING)) != -1) {
+			if (write(fd_in, r->target, strlen(r->target)) == -1 || write(fd_in, "\n", 1) == -1) {
+				close(fd_in);
+				fd_in = -1;
+			} else {
+				fd_in = sealMemfd(fd_in);
+			}
+		}
+	} else {
+		fd_in = open(r->target, O_RDONLY | O_CLOEXEC);
+	}
+	traceEvent(EV_REDIR, 0, 0, &arg_token, 1, fd_in);
+	if (fd_in < 0) {
+		fprintf(stdout, RED "micro-bash: %s: File o directory non esistente" RESET_COLOR "\n", r->target);
 		return -1;
 	}
 	return fd_in;
@@ -132,13 +331,15 @@ int openRedirInput(char *arg_token)
 
 
 /**************************************************************************************************************************
-Function for output redirection.
+Function for output redirection (">file" truncates the file, ">>file" writes at the end of the file).
 It returns -1 if any errors occurred, otherwise returns the file descriptor of the file.
 **************************************************************************************************************************/
-int openRedirOutput(char *arg_token)
+int openRedirOutput(char *arg_token, const redir * r)
 {
 	int fd_out = -2;
-	if ((fd_out = open(arg_token + 1, O_TRUNC | O_CREAT | O_RDWR, 0666)) < 0) {
+	fd_out = open(r->target, (r->type == R_APPEND ? O_APPEND : O_TRUNC) | O_CREAT | O_WRONLY | O_CLOEXEC, 0666);
+	traceEvent(EV_REDIR, 0, 0, &arg_token, 1, fd_out);
+	if (fd_out < 0) {
 		fprintf(stdout, RED "micro-bash: Errore in apertura del file per reindirizzamento in output" RESET_COLOR "\n");
 		return -1;
 	}
@@ -148,579 +349,661 @@ int openRedirOutput(char *arg_token)
 
 /**************************************************************************************************************************
 Function that does wait for each child of the parent process and checks if a child process has been stopped with status
-different from 0.
+different from 0 (only the processes of the n_stages commands are checked, the others are the relays of the shell).
+proc[i] is the process that has executed the command i (the same one for the filters joined together).
+The statuses of the commands are saved for $? and $PIPESTATUS: the filters joined together have the statuses that their
+process has written in the pipe status_fd[i] of the first one of them, or all the status of the process if it has been
+killed before writing them.
 It returns 0 if some error occurred, otherwise it returns 1.
 **************************************************************************************************************************/
-unsigned int wait_children_inPipe(int numPipes, int *status, int *pid)
+unsigned int wait_children_inPipe(pid_t * pids, unsigned int n, const unsigned int *proc, unsigned int n_stages, const int *status_fd)
+{
+	int *status = malloc(sizeof(int) * n), *stage_status = malloc(sizeof(int) * (n_stages + 1));
+	unsigned char *codes = malloc(n_stages + 1);
+	unsigned int ok = waitPids(pids, status, n), i, k, g;	// waitPids also applies the deadline, if there is one
+	for (i = 0; i < n_stages; i++) {
+		stage_status[i] = status[proc[i]];
+		if (n_stages > 1 && (i == 0 || proc[i] != proc[i - 1]) && WIFEXITED(status[proc[i]]) && WEXITSTATUS(status[proc[i]]) != 0)
+			fprintf(stdout, LIGHT_BLUE "Il processo con pid %d termina con status %d" RESET_COLOR "\n", pids[proc[i]], WEXITSTATUS(status[proc[i]]));
+	}
+	for (i = 0; i < n_stages; i += g) {	// the filters joined together: the statuses written by their process
+		for (g = 1; i + g < n_stages && proc[i + g] == proc[i]; g++);
+		if (g > 1 && status_fd[i] >= 0 && WIFEXITED(status[proc[i]]) && read(status_fd[i], codes, g) == (ssize_t) g)
+			for (k = 0; k < g; k++)
+				stage_status[i + k] = W_EXITCODE(codes[k], 0);
+	}
+	setPipeStatus(stage_status, n_stages);
+	free(codes);
+	free(stage_status);
+	free(status);
+	return ok;
+}
+
+
+/**************************************************************************************************************************
+Function that checks that all the redirections are correct (for example that I don't have the ">" and then a space).
+The redirections can be in any command of the pipeline and in any position after the name of the command.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int checkErrorPipedCommand(queue * q)
 {
-	for (int i = 0; i < numPipes + 1; i++) {
-		if (wait(status) == -1) {
+	redir r;
+	for (int i = q->first; i < q->last; i++)
+		if (isRedirection(q->array[i]) && !parseRedir(q->array[i], &r)) {
+			fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
 			return 0;
 		}
-		if (WIFEXITED(*status) && WEXITSTATUS(*status) != 0)
-			fprintf(stdout, LIGHT_BLUE "Il processo con pid %d termina con status %d" RESET_COLOR "\n", *pid, WEXITSTATUS(*status));
-	}
 	return 1;
 }
 
 
 /**************************************************************************************************************************
-Function for closing the file descriptor of the pipe and resetting the input and output of the program.
-It returns 0 if some error occurred, otherwise it returns 1.
+Function that divides the queue into the commands of the pipelines, with their arguments and redirections.
+It returns NULL if some error occurred, otherwise it returns the array of the *n_stages commands.
 **************************************************************************************************************************/
-unsigned int close_pipe(unsigned int *stdin_safe, unsigned int *stdout_safe, int numPipes, int *pipefds)
+stage *buildStages(queue * q, unsigned int *n_stages, unsigned int *n_segments)
 {
-	for (int i = 0; i < 2 * numPipes; i++)
-		if (close(pipefds[i]) == -1)
-			break;
-	free(pipefds);
-	if (dup2(*stdin_safe, 0) == -1) {	// reset the input
-		perror("Errore in dup2\n");
-		return 0;
+	unsigned int n = size(q), segment = 0;
+	stage *stages = calloc(n + 1, sizeof(stage));	// there can't be more commands than items in the queue
+	stage *cur = stages;
+	*n_stages = 0;
+	while (1) {
+		char *singleArg = isEmpty(q) ? NULL : dequeue(q);
+		if (singleArg == NULL || strcmp(singleArg, "|") == 0 || strcmp(singleArg, METER) == 0 || strcmp(singleArg, FANOUT) == 0) {
+			if (cur->argc == 0) {	// empty command (for example a pipe at the beginning of the line)
+				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
+				freeStages(stages, *n_stages + 1);
+				return NULL;
+			}
+			cur->argv[cur->argc] = NULL;	// null value at the end for execvp
+			cur->segment = segment;
+			(*n_stages)++;
+			if (singleArg == NULL)
+				break;
+			if (strcmp(singleArg, FANOUT) == 0)
+				segment++;
+			cur++;
+			cur->meter = strcmp(singleArg, METER) == 0 || (opts.pipemeter && strcmp(singleArg, "|") == 0);
+			continue;
+		}
+		if (cur->argv == NULL) {
+			cur->argv = malloc(sizeof(char *) * (n + 1));
+			cur->redirs = malloc(sizeof(char *) * n);
+		}
+		if (isRedirection(singleArg))
+			cur->redirs[cur->n_redirs++] = singleArg;
+		else
+			cur->argv[cur->argc++] = singleArg;
 	}
-	if (dup2(*stdout_safe, 1) == -1) {	// reset the output
-		perror("Errore in dup2\n");
-		return 0;
+	*n_segments = segment + 1;
+	return stages;
+}
+
+
+/**************************************************************************************************************************
+Function that frees the commands created by buildStages.
+**************************************************************************************************************************/
+void freeStages(stage * stages, unsigned int n_stages)
+{
+	for (unsigned int i = 0; i < n_stages; i++) {
+		free(stages[i].argv);
+		free(stages[i].redirs);
 	}
-	if (close(*stdout_safe) == -1)
-		return 0;
-	if (close(*stdin_safe) == -1)
+	free(stages);
+}
+
+
+/**************************************************************************************************************************
+Function that inserts a file descriptor in the list of the ones opened for the pipeline.
+**************************************************************************************************************************/
+void addFd(fd_list * l, int fd)
+{
+	if (l->n == l->dim) {
+		l->dim = l->dim == 0 ? 16 : 2 * l->dim;
+		l->fds = realloc(l->fds, sizeof(int) * l->dim);
+	}
+	l->fds[l->n++] = fd;
+}
+
+
+/**************************************************************************************************************************
+Function that closes all the file descriptors of the list, except the n ones in keep (keep can be NULL).
+**************************************************************************************************************************/
+void closeFds(fd_list * l, const int *keep, unsigned int n)
+{
+	for (unsigned int i = 0; i < l->n; i++) {
+		unsigned int k;
+		for (k = 0; k < n && keep[k] != l->fds[i]; k++);
+		if (k == n)
+			close(l->fds[i]);
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that creates a pipe whose file descriptors are closed by the execvp and inserts them in the list.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int openPipe(fd_list * l, int *p)
+{
+	if (pipe2(p, O_CLOEXEC) == -1) {
+		perror("Errore in pipe\n");
 		return 0;
+	}
+	addFd(l, p[0]);
+	addFd(l, p[1]);
 	return 1;
 }
 
 
 /**************************************************************************************************************************
-Function that checks if:
-  - I have the ">" and then a space;
-  - I have other after the ">file.extension";
-  - the "<" is in the correct position.
+Function that finds the source of the output fd of a command, that is redirected to all the files of the redirections
+">" and ">>" of fd (and to the n_cons pipes of cons): with only one target the command writes directly in it, otherwise
+it writes in the pipe of a new relay that copies the data to all the targets.
+It returns -1 if any errors occurred, otherwise it returns the file descriptor for the command.
+**************************************************************************************************************************/
+int outputSource(fd_list * l, const redir * r, const int *rfd, unsigned int n_redirs, int fd, const int *cons,
+		 unsigned int n_cons, relay * relays, unsigned int *n_relays)
+{
+	int *targets = malloc(sizeof(int) * (n_redirs + n_cons + 1)), p[2];
+	unsigned int n = 0;
+	for (unsigned int k = 0; k < n_redirs; k++)
+		if ((r[k].type == R_OUT || r[k].type == R_APPEND) && r[k].fd == fd)
+			targets[n++] = rfd[k];
+	for (unsigned int k = 0; k < n_cons; k++)
+		targets[n++] = cons[k];
+	if (n == 1) {	// only one output: the command writes directly in it
+		p[1] = targets[0];
+		free(targets);
+		return p[1];
+	}
+	if (!openPipe(l, p)) {
+		free(targets);
+		return -1;
+	}
+	fcntl(p[1], F_SETPIPE_SZ, RELAY_CHUNK);	// bigger pipe, fewer tee/splice (it can fail over /proc/sys/fs/pipe-max-size)
+	targets[n] = p[0];	// the relay reads from the element after the last target
+	relays[*n_relays].in = p[0];
+	relays[*n_relays].targets = targets;
+	relays[*n_relays].n = n;
+	relays[*n_relays].meter = 0;
+	(*n_relays)++;
+	return p[1];
+}
+
+
+/**************************************************************************************************************************
+Function that applies the actions of a command in the child process, in the order in which they have been written.
+The file descriptors of the shell are first moved above all the ones that are redirected, so that a redirection can't
+close the source of one of the next ones.
 It returns 0 if some error occurred, otherwise it returns 1.
 **************************************************************************************************************************/
-unsigned int checkErrorPipedCommand(queue * q)
+unsigned int applyActions(action * acts, unsigned int n)
 {
-	queue q2;
-	// Support queue creation and copy
-	create(&q2, size(q));
-	copyQueue(q, &q2);
-	
-	char * s1 = NULL;
-	do{						// I take the first command (command up to pipe or empty queue)
-		if (isEmpty(&q2))
-			break;
-		s1 = dequeue(&q2);	// I take first element from the support queue
-	} while (strcmp(s1, "|") != 0); // as long as I have pipes
-	while (!isEmpty(&q2)){
-		s1 = dequeue(&q2);		// I take the second command
-		if (s1[0] == '>'){	
-			if (strlen(s1) == 1) {	// I have the ">" and then a space: that's not good
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				reset(&q2);
-				return 0;
-			}
-			if (!isEmpty(&q2)) {	// I have something else after the ">file.extension": that's not good
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				reset(&q2);
-				return 0;
-			}
+	int high = 10;
+	unsigned int k;
+	for (k = 0; k < n; k++) {
+		if (acts[k].fd >= high)
+			high = acts[k].fd + 1;
+		if (acts[k].dup && acts[k].src >= high)
+			high = acts[k].src + 1;
+	}
+	for (k = 0; k < n; k++)
+		if (!acts[k].dup && (acts[k].src = fcntl(acts[k].src, F_DUPFD_CLOEXEC, high)) == -1) {
+			perror("Errore in fcntl\n");
+			return 0;
 		}
-		if (s1[0] == '<') {	// error because the "<" I can only have it on the first command that is checked outside the while
-			fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-			reset(&q2);
+	for (k = 0; k < n; k++)
+		if (acts[k].src != acts[k].fd && dup2(acts[k].src, acts[k].fd) == -1) {
+			fprintf(stdout, RED "micro-bash: %d: descrittore di file non valido" RESET_COLOR "\n", acts[k].src);
 			return 0;
 		}
-	}
-	reset(&q2);
 	return 1;
 }
 
 
 /**************************************************************************************************************************
-Function for executing commands with the pipe.
+Function that closes in the child process the file descriptors that the execvp would close: the ones of the pipeline
+that have not been redirected and the copies made by applyActions.
+**************************************************************************************************************************/
+void closeActionFds(fd_list * l, action * acts, unsigned int n)
+{
+	unsigned int i, k;
+	for (k = 0; k < n; k++)
+		if (!acts[k].dup && acts[k].src != acts[k].fd)
+			close(acts[k].src);
+	for (i = 0; i < l->n; i++) {
+		for (k = 0; k < n && acts[k].fd != l->fds[i]; k++);
+		if (k == n)
+			close(l->fds[i]);
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that closes in a child process that doesn't call execvp (builtin, filters and relays) the pipes of the
+coprocesses, that otherwise would remain open while it runs and would delay the end of the data for the coprocess.
+The file descriptors that are targets of the n_acts actions and the n_keep ones in keep are not closed.
+**************************************************************************************************************************/
+void closeCoprocFds(const action * acts, unsigned int n_acts, const int *keep, unsigned int n_keep)
+{
+	int fds[2 * MAXCOPROC];
+	unsigned int n = coprocFds(fds), i, k;
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < n_acts && acts[k].fd != fds[i]; k++);
+		if (k < n_acts)
+			continue;
+		for (k = 0; k < n_keep && keep[k] != fds[i]; k++);
+		if (k == n_keep)
+			close(fds[i]);
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that prepares the execution of the commands of a pipeline, without creating any process: the pipes, the files of
+the redirections and the actions of each command, the filters joined together and the relays.
+Each command reads from the pipe of the previous one and writes in the pipe of the next one, then its redirections are
+applied in the order in which they have been written (so they can replace the pipes).
+A file descriptor of a command with more outputs (more ">" of the same fd, or other pipelines after "|&|") is a pipe read
+by a relay process of the shell, which copies the data to all the outputs with tee(2) and splice(2).
+Adjacent builtin filters ("grep -F", "cut", "wc", "head") are executed by only one process (the first one can have
+redirections of the input and the last one of the output).
+pl has to be freed with freePipeline also if some error occurred (after closeFds on its file descriptors).
 It returns 0 if some error occurred, otherwise it returns 1.
 **************************************************************************************************************************/
-unsigned int runPipedCommands(queue * q, char **command, int n_arg, int numPipes)
-{
-	int status, *pipefds;
-	unsigned int i, first = 0, j = 0;
-	pid_t pid;
-	unsigned int redirect_Out = 0;	// 0 false; 1 true
-	int std_save;		// for the ">" and "<"
-	unsigned int stdin_safe = dup(STDIN_FILENO);	// variable to save the stdin
-	unsigned int stdout_safe = dup(STDOUT_FILENO);	// variable to save the stdout
-	pipefds = (int *)malloc(sizeof(int) * (2 * numPipes));
-	for (i = 0; i < numPipes; i++)
-		if (pipe(pipefds + i * 2) == -1) {
-			perror("Errore in pipe\n");
-			close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds);
-			free(command);
-			return 0;
+unsigned int preparePipeline(stage * stages, unsigned int n_stages, unsigned int n_segments, pipeline * pl)
+{
+	int *fd_in = malloc(sizeof(int) * n_stages), *fd_out = malloc(sizeof(int) * n_stages);
+	int *cons = malloc(sizeof(int) * n_segments);	// pipes towards the pipelines after "|&|"
+	action **acts = pl->acts = calloc(n_stages, sizeof(action *));
+	unsigned int *n_acts = pl->n_acts = calloc(n_stages, sizeof(unsigned int));
+	unsigned int *fused = pl->fused = calloc(n_stages, sizeof(unsigned int));
+	unsigned int i, n_relays = 0, max_relays = 0, n_cons = 0, last0 = 0, ok = 1;
+	fd_list *l = &pl->l;
+	relay *relays;
+	int p[2];
+	filter f;
+	*l = (fd_list) { NULL, 0, 0 };
+	for (i = 0; i < n_stages; i++) {
+		fd_in[i] = fd_out[i] = -1;	// -1: the one of the shell
+		max_relays += stages[i].n_redirs + 2;	// the outputs and the meter
+		if (stages[i].segment == 0)
+			last0 = i;	// last command of the first pipeline
+	}
+	// adjacent builtin filters are executed by the same process, without the pipe between them; only the first one of
+	// a group can have redirections of the input and only the last one redirections of the output
+	for (i = 1; i < n_stages; i++)
+		fused[i] = stages[i].segment == stages[i - 1].segment && !stages[i].meter
+		    && parseFilter(stages[i - 1].argv, stages[i - 1].argc, &f) && parseFilter(stages[i].argv, stages[i].argc, &f)
+		    && (stages[i - 1].n_redirs == 0 || (!fused[i - 1] && onlyRedirs(&stages[i - 1], 0)))
+		    && onlyRedirs(&stages[i], 1);
+	while (fused[last0])	// the output of the first pipeline comes from the process of its last filters
+		last0--;
+	relays = pl->relays = malloc(sizeof(relay) * max_relays);
+	// pipes between the commands of the same pipeline
+	for (i = 0; ok && i + 1 < n_stages; i++)
+		if (stages[i + 1].segment == stages[i].segment && !fused[i + 1] && (ok = openPipe(l, p))) {
+			fd_out[i] = p[1];
+			fd_in[i + 1] = p[0];
+			if (stages[i + 1].meter && (ok = openPipe(l, p))) {	// the meter reads the first pipe and writes in a second one
+				int *targets = malloc(sizeof(int) * 2);
+				targets[0] = p[1];
+				targets[1] = fd_in[i + 1];
+				relays[n_relays++] = (relay) { fd_in[i + 1], targets, 1, i + 1 };
+				fd_in[i + 1] = p[0];
+			}
 		}
-	// I check the "<"
-	for (int k = 0; k < n_arg - 1; k++)	// I check if it has been inserted in the first command in the wrong position (i.e. before the last argument)
-		if (command[k][0] == '<') {
-			fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-			close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds);
-			free(command);
-			return 0;
+	for (i = n_stages - 1; i > 0; i--)	// the first filter of a group writes where the last one would write
+		if (fused[i])
+			fd_out[i - 1] = fd_out[i];
+	// the other pipelines read the output of the first one
+	for (i = last0 + 1; ok && i < n_stages; i++)
+		if (stages[i].segment != stages[i - 1].segment && (ok = openPipe(l, p))) {
+			fd_in[i] = p[0];
+			cons[n_cons++] = p[1];
 		}
-	// I check if the "<" is in the last position and proceed to change the standard input
-	if (command[n_arg - 1][0] == '<') {
-		if (strlen(command[n_arg - 1]) == 1) {
-			fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-			close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds);
-			return 0;
+	// redirections of each command (of a group: the ones of the input of the first filter and of the output of the last)
+	for (i = 0; ok && i < n_stages; i++) {
+		unsigned int n_redirs = stages[i].n_redirs, out1 = 0, k, j, g = i;
+		if (fused[i])
+			continue;
+		while (g + 1 < n_stages && fused[g + 1])
+			g++;
+		unsigned int n_c = i == last0 ? n_cons : 0;
+		char **redirs = malloc(sizeof(char *) * (n_redirs + (g > i ? stages[g].n_redirs : 0) + 1));
+		memcpy(redirs, stages[i].redirs, sizeof(char *) * n_redirs);
+		if (g > i) {
+			memcpy(redirs + n_redirs, stages[g].redirs, sizeof(char *) * stages[g].n_redirs);
+			n_redirs += stages[g].n_redirs;
 		}
-		if ((std_save = openRedirInput(command[n_arg - 1])) == -1) {
-			free(pipefds);
-			free(command);
-			return 0;
+		redir *r = malloc(sizeof(redir) * (n_redirs + 1));
+		int *rfd = malloc(sizeof(int) * (n_redirs + 1));
+		action *a = acts[i] = malloc(sizeof(action) * (n_redirs + 2));
+		for (k = 0; ok && k < n_redirs; k++) {
+			parseRedir(redirs[k], &r[k]);	// the parser has already checked them
+			rfd[k] = -1;
+			if (r[k].type == R_DUP && !isdigit((unsigned char)r[k].target[0])) {	// ">&NAME" or "<&NAME": a pipe of the coprocess
+				if ((rfd[k] = coprocFd(r[k].target, r[k].target[-2] == '>')) < 0)
+					ok = 0;
+				continue;	// it is not in the list: the pipes of the coprocess remain open after the pipeline
+			}
+			if (r[k].type == R_DUP)
+				continue;
+			if (r[k].type == R_OUT || r[k].type == R_APPEND) {
+				rfd[k] = openRedirOutput(redirs[k], &r[k]);
+				out1 |= r[k].fd == STDOUT_FILENO;
+			} else {
+				rfd[k] = openRedirInput(redirs[k], &r[k]);
+			}
+			if (rfd[k] < 0)
+				ok = 0;
+			else
+				addFd(l, rfd[k]);
 		}
-		n_arg--;
-		// if there is to change the standard input with the file or path (so using "<")
-		if (dup2(std_save, 0) == -1) {
-			perror("Errore dup2 stdin in file\n");
-			close(std_save);
-			free(pipefds);
-			free(command);
-			return 0;
+		if (ok && fd_in[i] >= 0)	// INPUT from the pipe
+			a[n_acts[i]++] = (action) { STDIN_FILENO, fd_in[i], 0 };
+		if (ok && n_c > 0 && !out1) {	// OUTPUT only to the pipelines after "|&|"
+			if ((p[1] = outputSource(l, r, rfd, 0, STDOUT_FILENO, cons, n_c, relays, &n_relays)) < 0)
+				ok = 0;
+			a[n_acts[i]++] = (action) { STDOUT_FILENO, p[1], 0 };
+		} else if (ok && fd_out[i] >= 0) {	// OUTPUT in the pipe
+			a[n_acts[i]++] = (action) { STDOUT_FILENO, fd_out[i], 0 };
 		}
-		if (close(std_save) == -1) {
-			free(pipefds);
-			free(command);
-			return 0;
+		for (k = 0; ok && k < n_redirs; k++) {
+			if (r[k].type == R_DUP && rfd[k] >= 0) {
+				a[n_acts[i]++] = (action) { r[k].fd, rfd[k], 0 };
+				continue;
+			}
+			if (r[k].type == R_DUP) {
+				a[n_acts[i]++] = (action) { r[k].fd, atoi(r[k].target), 1 };
+				continue;
+			}
+			if (r[k].type != R_OUT && r[k].type != R_APPEND) {
+				a[n_acts[i]++] = (action) { r[k].fd, rfd[k], 0 };
+				continue;
+			}
+			for (j = 0; j < k && !((r[j].type == R_OUT || r[j].type == R_APPEND) && r[j].fd == r[k].fd); j++);
+			if (j < k)	// the outputs of this fd have already been joined at the first redirection
+				continue;
+			if ((p[1] = outputSource(l, r, rfd, n_redirs, r[k].fd, cons, r[k].fd == STDOUT_FILENO ? n_c : 0, relays, &n_relays)) < 0)
+				ok = 0;
+			a[n_acts[i]++] = (action) { r[k].fd, p[1], 0 };
 		}
+		free(redirs);
+		free(r);
+		free(rfd);
 	}
+	pl->n_relays = n_relays;
+	free(fd_in);
+	free(fd_out);
+	free(cons);
+	return ok;
+}
 
 
-	while (!isEmpty(q)) {
-		
-		while (!isEmpty(q) && j > 0) {
-			command = (char **)realloc(command, sizeof(char *) * (n_arg + 1));
-			char *singleArg;
-			singleArg = dequeue(q);
-			if (singleArg[0] == '|'){	// after pipe I have nothing left
-				break;
-			}
+/**************************************************************************************************************************
+Function that frees what preparePipeline has allocated for the n_stages commands (the file descriptors are not closed).
+**************************************************************************************************************************/
+void freePipeline(pipeline * pl, unsigned int n_stages)
+{
+	for (unsigned int i = 0; i < n_stages; i++)
+		free(pl->acts[i]);
+	for (unsigned int i = 0; i < pl->n_relays; i++)
+		free(pl->relays[i].targets);
+	free(pl->relays);
+	free(pl->acts);
+	free(pl->n_acts);
+	free(pl->fused);
+	free(pl->l.fds);
+}
 
-			// I check the ">"
-			if (singleArg[0] == '>') {
-				redirect_Out = 1;
-				// I take the new stdout
-				if ((std_save = openRedirOutput(singleArg)) == -1) {
-					wait_children_inPipe(numPipes, &status, &pid);
-					close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds);
-					free(command);
-					return 0;
-				}
+
+/**************************************************************************************************************************
+Function for executing commands with the pipe: the pipeline prepared by preparePipeline is started, a process for each
+command (or group of filters) and for each relay.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int runPipedCommands(stage * stages, unsigned int n_stages, unsigned int n_segments)
+{
+	pipeline pl;
+	unsigned int ok = preparePipeline(stages, n_stages, n_segments, &pl);
+	unsigned int *proc = malloc(sizeof(unsigned int) * n_stages), *fused = pl.fused, *n_acts = pl.n_acts;
+	unsigned int i, n_pids = 0, n_started;
+	action **acts = pl.acts;
+	relay *relays = pl.relays;
+	pid_t *pids = malloc(sizeof(pid_t) * (n_stages + pl.n_relays));	// pids of the commands and then of the relays
+	int *status_fd = malloc(sizeof(int) * n_stages);	// pipes with the statuses of the filters joined together
+	for (i = 0; i < n_stages; i++)
+		status_fd[i] = -1;
+	fflush(stdout);	// so that the children don't write again what is still in the buffer
+	for (i = 0; ok && i < n_stages; i++) {
+		pid_t pid;
+		uint64_t fork_start;
+		int p[2] = { -1, -1 };
+		if (fused[i]) {	// executed by the process of the first filter of the group
+			proc[i] = n_pids - 1;
+			continue;
+		}
+		if (i + 1 < n_stages && fused[i + 1]) {	// the process of a group writes the status of each filter in a pipe
+			if (pipe2(p, O_CLOEXEC | O_NONBLOCK) == -1) {
+				perror("Errore in pipe\n");
+				ok = 0;
 				break;
 			}
-			command[n_arg] = singleArg;
-			n_arg++;
+			status_fd[i] = p[0];
 		}
-		command = (char **)realloc(command, sizeof(char *) * (n_arg + 1));
-		command[n_arg] = NULL;	// null value at the end for execvp
-		pid = fork();
-		if (pid == 0) {	// SON PROCESS
-			// OUTPUT
-			if (redirect_Out == 1) {
-				// if there is to change standard output with the file (so using ">")
-				if (dup2(std_save, 1) == -1) {
-					perror("Errore dup2 stdout in file\n");
-					close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds);
-					free(command);
-					return 0;
-				}
-				if (close(std_save) == -1) {
-					free(command);
-					free(pipefds);
-					return 0;
-				}
-			} else {
-				// if it is not the last command
-				if (j < 2 * numPipes) {
-					if (dup2(pipefds[j + 1], 1) == -1) {
-						perror("Errore dup2 output - PIPE\n");
-						close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds);
-						free(command);
-						return 0;
-					}
-				}
-			}
-
-			// INPUT
-			// if I am not in the first command
-			if (j != 0) {
-				if (dup2(pipefds[j - 2], 0) == -1) {
-					perror("Errore dup2 input - PIPE\n");
-					close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds);
-					free(command);
-					return 0;
-				}
-			}
-
-			// I close all open file descriptor for pipes
-			for (i = 0; i < 2 * numPipes; i++)
-				if (close(pipefds[i]) == -1)
-					break;
-
-			// I execute the instruction
-			if (execvp(command[first], command + first) == -1) {
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! *** - Errore di: %s" RESET_COLOR "\n", command[first]);
-				close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds);
-				free(command);
-				exit(EXIT_FAILURE);
-			}
-
-		} else if (pid < 0) {	// if the fork gave an error
+		fork_start = trace_on ? traceNow() : 0;	// the fork event starts before the fork, the child can run first
+		if ((pid = fork()) == 0) {	// SON PROCESS
+			unsigned int g = 1;
+			int *status;
+			unsigned char *codes;
+			if (!applyActions(acts[i], n_acts[i])) {	// INPUT, OUTPUT and the other redirections
+				fflush(stdout);
+				_exit(EXIT_FAILURE);
+			}
+			// the other file descriptors of the pipeline are closed by the execvp (O_CLOEXEC)
+			prepareChild();
+			if (isStageBuiltin(stages[i].argv, stages[i].argc)) {	// there is no execvp: I close myself the file descriptors of the pipeline
+				closeActionFds(&pl.l, acts[i], n_acts[i]);
+				closeCoprocFds(acts[i], n_acts[i], NULL, 0);
+				while (i + g < n_stages && fused[i + g])
+					g++;
+				status = malloc(sizeof(int) * g);
+				codes = malloc(g);
+				runStageBuiltin(stages + i, g, status);
+				for (unsigned int k = 0; k < g; k++)
+					codes[k] = status[k];
+				if (g > 1 && write(p[1], codes, g) == -1)	// less than PIPE_BUF bytes: the pipe can't be full
+					perror("Errore in scrittura degli status\n");
+				fflush(stdout);
+				_exit(status[g - 1]);
+			}
+			traceChild(EV_EXEC, stages[i].argv, 0);
+			execvp(stages[i].argv[0], stages[i].argv);	// I execute the instruction
+			fprintf(stdout, RED "*** COMANDO ERRATO!!! *** - Errore di: %s" RESET_COLOR "\n", stages[i].argv[0]);
+			fflush(stdout);
+			_exit(EXIT_FAILURE);	// exit() would move back the offset of the input of the shell if it is a file
+		}
+		if (p[1] >= 0)	// only the child writes the statuses
+			close(p[1]);
+		if (pid < 0) {	// if the fork gave an error
 			perror("Errore fork in pipe\n");
-			free(pipefds);
-			free(command);
-			return 0;
+			ok = 0;
+			break;
 		}
 		// FATHER PROCESS
-		j += 2;
-		first = n_arg;
+		traceEvent(EV_FORK, fork_start, pid, stages[i].argv, stages[i].argc, 0);
+		deadlineForked(pid);
+		proc[i] = n_pids;
+		pids[n_pids++] = pid;
 	}
-
-	// I close all open file descriptor for pipes
-	for (i = 0; i < 2 * numPipes; i++)
-		if (close(pipefds[i]) == -1)
+	n_started = i;
+	for (i = 0; ok && i < pl.n_relays; i++) {	// the relays of the file descriptors with more outputs and the meters
+		char *relay_argv[] = { relays[i].meter ? "(meter)" : "(tee)", NULL };
+		unsigned int m = relays[i].meter;
+		pid_t pid;
+		uint64_t fork_start = trace_on ? traceNow() : 0;
+		if ((pid = fork()) == 0) {
+			closeFds(&pl.l, relays[i].targets, relays[i].n + 1);	// the relay must not keep open the pipes of the others
+			closeCoprocFds(NULL, 0, relays[i].targets, relays[i].n + 1);	// nor the ones of the coprocesses
+			prepareChild();
+			if (m)
+				_exit(meterRelay(relays[i].in, relays[i].targets[0], m, stages[m - 1].argv[0], stages[m].argv[0]) ? EXIT_SUCCESS : EXIT_FAILURE);
+			_exit(teeRelay(relays[i].in, relays[i].targets, relays[i].n) ? EXIT_SUCCESS : EXIT_FAILURE);	// _exit: the stdio of the shell must not be touched
+		} else if (pid < 0) {
+			perror("Errore fork in pipe\n");
+			ok = 0;
 			break;
-	// I do wait for each child and check if any of them have failed to execute and close the pipes by resetting inputs and outputs
-	if (!wait_children_inPipe(numPipes, &status, &pid)) {
-		free(pipefds);
-		free(command);
-		return 0;
-	}
-	if (!close_pipe(&stdin_safe, &stdout_safe, numPipes, pipefds)) {
-		free(command);
-		return 0;
+		}
+		traceEvent(EV_FORK, fork_start, pid, relay_argv, 1, 0);
+		deadlineForked(pid);
+		pids[n_pids + i] = pid;
 	}
-	free(command);
-	return 1;
+	// I close all open file descriptor of the pipeline, so that the children can see the end of the data
+	closeFds(&pl.l, NULL, 0);
+	// I do wait for each child and check if any of them have failed to execute
+	if (!wait_children_inPipe(pids, n_pids + i, proc, n_started, status_fd))
+		ok = 0;
+	for (i = 0; i < n_stages; i++)
+		if (status_fd[i] >= 0)
+			close(status_fd[i]);
+	if (n_started < n_stages)	// some command has not been started
+		setStatus(1);
+	freePipeline(&pl, n_stages);
+	free(status_fd);
+	free(proc);
+	free(pids);
+	return ok;
 }
 
 
 /**************************************************************************************************************************
-Function that analyzes the commands entered and calls the correct functions in the case of a single command, redirection
-input/output and pipe.
+Function that analyzes the commands entered and calls the correct functions in the case of a builtin command ("cd",
+"ulimit", "set", "coproc") or of a pipeline (also with only one command) with its redirections.
 It returns 0 if some error occurred, otherwise it returns 1.
 **************************************************************************************************************************/
-unsigned int execCommand(queue * q, unsigned int num_pipe)
+unsigned int execCommand(queue * q)
 {
-	char *singleArg, *singleArg2;
-	int n_arg = 0, n_comm = 0;
-	char **commArray = NULL;
+	stage *stages;
+	unsigned int n_stages, n_segments, i, ok;
 	if (isEmpty(q))	// if there are no commands
 		return 0;
-	while (!isEmpty(q)) {
-		commArray = (char **)realloc(commArray, sizeof(char *) * (n_arg + 1));
-		singleArg = dequeue(q);	// I take the argument
-		if (strcmp(singleArg, "|") == 0) {	// I check the pipe
-			if (n_arg == 0) {	// if I have a pipe at the beginning of the line
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			n_comm++;
-			if (strcmp(commArray[0], "cd") == 0) {	// if I have the "cd" command along with a pipe it must fail
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			if (!runPipedCommands(q, commArray, n_arg, num_pipe))	// I execute the function for the pipe
-				return 0;
-			return 1;
-		} else if (singleArg[0] == '<' && !isEmpty(q) && num_pipe == 0) {	// if I have a "<" (and then a ">")
-			if (n_arg == 0) {
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			n_comm++;
-			singleArg2 = dequeue(q);
-			if (!isEmpty(q)) {	// if I have anything else after "<file.extension >file.extension" I have an error
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			if (singleArg2[0] == '>') {	// if I found the ">"
-				n_comm++;
-				if (n_comm > 2) {
-					fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-					free(commArray);
-					return 0;
-				}
-				if (strcmp(commArray[0], "cd") == 0) {	// if I have "cd" I have error
-					fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-					free(commArray);
-					return 0;
-				}
-				int fd_out;	// I change output
-				if ((fd_out = openRedirOutput(singleArg2)) == -1) {
-					free(commArray);
-					return 0;
-				}
-				int fd_in;	// I change input
-				if ((fd_in = openRedirInput(singleArg)) == -1) {
-					free(commArray);
-					return 0;
-				}
-				pid_t child_pid;
-				commArray[n_arg] = NULL;	// null value at the end for execvp
-				if ((child_pid = fork()) == -1) {
-					free(commArray);
-					return 0;
-				}
-				if (child_pid == 0) {	// SON PROCESS
-					if (dup2(fd_in, STDIN_FILENO) == -1) {
-						perror("Errore dup2 per ridirezione in input\n");
-						free(commArray);
-						return 0;
-					}
-					if (dup2(fd_out, STDOUT_FILENO) == -1) {
-						perror("Errore dup2 per ridirezione in input\n");
-						free(commArray);
-						return 0;
-					}
-					execvp(commArray[0], commArray);	// I execute the command
-					fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-					free(commArray);
-					exit(EXIT_FAILURE);
-				} else {	// FATHER PROCESS
-					if (wait(NULL) == -1) {
-						free(commArray);
-						return 0;
-					}
-					if (close(fd_in) == -1) {
-						free(commArray);
-						return 0;
-					}
-					if (close(fd_out) == -1) {
-						free(commArray);
-						return 0;
-					}
-					free(commArray);
-				}
-			} else {
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			return 1;
-		} else if (singleArg[0] == '>' && !isEmpty(q) && num_pipe == 0) {	// if I have ">" (and then a "<")
-			if (n_arg == 0) {
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			n_comm++;
-			singleArg2 = dequeue(q);
-			if (!isEmpty(q)) {	// if I have anything else after ">file.extension <file.extension" I have an error
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			if (singleArg2[0] == '<') {	// if after I have "<" 
-				n_comm++;
-				if (n_comm > 2) {
-					fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-					free(commArray);
-					return 0;
-				}
-				if (strcmp(commArray[0], "cd") == 0) {	// if I have "cd" I have error
-					fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-					free(commArray);
-					return 0;
-				}
-				int fd_out;	// I change output
-				if ((fd_out = openRedirOutput(singleArg)) == -1) {
-					free(commArray);
-					return 0;
-				}
-				int fd_in;	// I change input
-				if ((fd_in = openRedirInput(singleArg2)) == -1) {
-					free(commArray);
-					return 0;
-				}
-				pid_t child_pid;
-				commArray[n_arg] = NULL;	// null value at the end for execvp
-				if ((child_pid = fork()) == -1) {
-					free(commArray);
-					return 0;
-				}
-				if (child_pid == 0) {	// SON PROCESS
-					if (dup2(fd_in, STDIN_FILENO) == -1) {
-						perror("Errore dup2 per ridirezione in input\n");
-						free(commArray);
-						return 0;
-					}
-					if (dup2(fd_out, STDOUT_FILENO) == -1) {
-						perror("Errore dup2 per ridirezione in output\n");
-						free(commArray);
-						return 0;
-					}
-					execvp(commArray[0], commArray);	// I execute the command
-					fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-					free(commArray);
-					exit(EXIT_FAILURE);
-				} else {	// FATHER PROCESS
-					if (wait(NULL) == -1) {
-						free(commArray);
-						return 0;
-					}
-					if (close(fd_in) == -1) {
-						free(commArray);
-						return 0;
-					}
-					if (close(fd_out) == -1) {
-						free(commArray);
-						return 0;
-					}
-					free(commArray);
-				}
-			} else {
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			return 1;
-		} else if (singleArg[0] == '<' && isEmpty(q)) {	// simple input redirection control
-			if (n_arg == 0) {
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			n_comm++;
-			if (n_comm > 2) {
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			if (strcmp(commArray[0], "cd") == 0) {	// if I have "cd" it's not good
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			if (n_comm != 1) {	// I check that the "<" has been inserted in the first command
-				fprintf(stdout, RED "*** Errore di ridirezione in input ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			int fd_in;	// I change input
-			if ((fd_in = openRedirInput(singleArg)) == -1) {
-				free(commArray);
-				return 0;
-			}
-			if (!execSingleCommand(commArray, n_arg, fd_in, -2)) {	// I use the function for executing the command with input redirection
-				close(fd_in);
-				free(commArray);
-				return 0;
-			}
-			if (close(fd_in) == -1) {
-				free(commArray);
-				return 0;
-			}
-			return 1;
-		} else if (singleArg[0] == '>') {	// I check output redirection
-			if (n_arg == 0) {
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			n_comm++;
-			if (strcmp(commArray[0], "cd") == 0) {	// if I have "cd" it's not good
-				fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			if (!isEmpty(q)) {	// I check that the ">" is the last command
-				fprintf(stdout, RED "*** Errore di ridirezione in output ***" RESET_COLOR "\n");
-				free(commArray);
-				return 0;
-			}
-			int fd_out;	// I change output
-			if ((fd_out = openRedirOutput(singleArg)) == -1) {
-				free(commArray);
-				return 0;
-			}
-			if (!execSingleCommand(commArray, n_arg, -2, fd_out)) {	// I use the function for executing the command with output redirection
-				close(fd_out);
-				free(commArray);
-				return 0;
-			}
-			if (close(fd_out) == -1) {
-				free(commArray);
-				return 0;
-			}
-			return 1;
-		}
-		commArray[n_arg] = singleArg;
-		n_arg++;
-	}
-	// if I didn't have "|" or "<" or ">" I do the operation on the single command
-	if (strcmp(commArray[0], "cd") == 0) {	// if the first argument is "cd"
-		if (n_arg == 1){	// if there is only one argument, that is "cd"
-			if (!cd(NULL, n_arg)) {
-				free(commArray);
-				return 0;	// if it fails
-			}
-		} else {
-			if (!cd(commArray[1], n_arg)) {
-				free(commArray);
-				return 0;	// if it fails
-			}
+	if ((stages = buildStages(q, &n_stages, &n_segments)) == NULL)
+		return 0;
+	if (n_stages == 1 && stages[0].n_redirs == 0) {	// the builtin commands are executed by the shell
+		char **commArray = stages[0].argv;
+		unsigned int n_arg = stages[0].argc;
+		ok = 2;
+		if (strcmp(commArray[0], "cd") == 0)	// if the first argument is "cd"
+			ok = cd(n_arg == 1 ? NULL : commArray[1], n_arg);	// "cd" with only one argument goes in the HOME
+		else if (strcmp(commArray[0], "ulimit") == 0)
+			ok = ulimit(commArray, n_arg);
+		else if (strcmp(commArray[0], "set") == 0)
+			ok = set(commArray, n_arg);
+		else if (strcmp(commArray[0], "coproc") == 0)
+			ok = coproc(commArray, n_arg);
+		if (ok != 2) {
+			setStatus(!ok);
+			freeStages(stages, n_stages);
+			return ok;
 		}
-		free(commArray);
-	} else {
-		if (!execSingleCommand(commArray, n_arg, -2, -2)) {	// I use the function for single command execution
-			free(commArray);
+	}
+	for (i = 0; i < n_stages; i++)
+		if (strcmp(stages[i].argv[0], "cd") == 0 || strcmp(stages[i].argv[0], "coproc") == 0) {	// if I have the "cd" (or "coproc") command along with a pipe or a redirection it must fail
+			fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
+			freeStages(stages, n_stages);
 			return 0;
 		}
-	}
-	return 1;
+	ok = runPipedCommands(stages, n_stages, n_segments);
+	freeStages(stages, n_stages);
+	return ok;
 }
 
 
 /**************************************************************************************************************************
-Function that splits the string entered in input by the user.
-It returns 0 if some error occurred, otherwise it returns 1.
+Function that splits the string entered in input by the user into the queue and checks the syntax of pipes and
+redirections, without executing anything (so it can also be called by the fuzz harness, see fuzz/parse_fuzz.c).
+It returns 0 if some error occurred, otherwise it returns 1 (also for a line with only spaces, with the queue empty).
 **************************************************************************************************************************/
-unsigned int parser(char *complete_comm, queue * q)
+unsigned int parseLine(char *complete_comm, queue * q)
 {
-	unsigned int num_pipe = 0, i;
-	char *comm_token, *arg_token;
-	complete_comm[strlen(complete_comm) - 1] = 0;	// to avoid including the final '\n' in the string
-	for (i = 0; i < strlen(complete_comm); i++)	// to remove tabs
+	unsigned int i;
+	char *comm_token, *arg_token, *fanout;
+	uint64_t start = trace_on ? traceNow() : 0;
+	size_t len = strlen(complete_comm);
+	if (len > 0 && complete_comm[len - 1] == '\n')	// to avoid including the final '\n' in the string (the last line can be without it)
+		complete_comm[--len] = 0;
+	for (i = 0; i < len; i++)	// to remove tabs
 		if (complete_comm[i] == '\t')
 			complete_comm[i] = ' ';
-	if(complete_comm[0] == '|' || complete_comm[strlen(complete_comm)-1] == '|'){
+	if (len > 0 && (complete_comm[0] == '|' || complete_comm[len - 1] == '|')) {
 		fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
 		return 0;
 	}
+	while ((fanout = strstr(complete_comm, FANOUT)) != NULL)	// the "|&|" becomes a separate argument, without '|'
+		memcpy(fanout, " \x1e ", 3);
+	while ((fanout = strstr(complete_comm, METER)) != NULL)	// in "|:" the ':' is marked, so it can't be an argument
+		fanout[1] = '\x1d';
 	while ((comm_token = strtok_r(complete_comm, "|", &complete_comm))) {	// decomposition by pipe "|"
-		while ((arg_token = strtok_r(comm_token, " ", &comm_token))) {	// decomposition by spaces
+		while ((arg_token = strtok_r(comm_token, " \x1d", &comm_token))) {	// decomposition by spaces
 			if (arg_token[0] == '$') {	// if at the beginning of an argument there is a '$'
-				if ((arg_token = environmentVar(arg_token)) == NULL)
+				if ((arg_token = environmentVar(arg_token)) == NULL) {
+					traceEvent(EV_PARSE, start, 0, q->array + q->first, size(q), 1);
 					return 0;
+				}
 			}
-			
+			if (strcmp(arg_token, "\x1e") == 0)
+				arg_token = FANOUT;
 			enqueue(q, arg_token);
 		}
-		if (strlen(complete_comm) > 0) {	// I insert the pipe
-			enqueue(q, "|");
-			num_pipe++;
-		}
-		if (!checkErrorPipedCommand(q))	// I check for redirection errors
-			return 0;
+		if (strlen(complete_comm) > 0)	// I insert the pipe
+			enqueue(q, complete_comm[0] == '\x1d' ? METER : "|");
+	}
+	if (isEmpty(q))	// line with only spaces: there is nothing to execute
+		return 1;
+	if (!checkErrorPipedCommand(q)) {	// I check for redirection errors
+		traceEvent(EV_PARSE, start, 0, q->array + q->first, size(q), 1);
+		return 0;
 	}
-		
+
 	if (checkPipeError(q)) {	// I check if I have more than one consecutive pipe
 		fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
+		traceEvent(EV_PARSE, start, 0, q->array + q->first, size(q), 1);
 		return 0;
 	}
-	if (!execCommand(q, num_pipe))	// command execution
-		return 0;
+	traceEvent(EV_PARSE, start, 0, q->array + q->first, size(q), 0);
 	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that splits the string entered in input by the user and executes it.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int parser(char *complete_comm, queue * q)
+{
+	unsigned int i;
+	if (!parseLine(complete_comm, q))
+		return 0;
+	if (isEmpty(q))	// line with only spaces: there is nothing to execute
+		return 1;
+	if (!readHereDocs(q)) {
+		closeHereDocs();
+		return 0;
+	}
+	do {	// I read the "limit" and "timeout" prefixes, in any order
+		i = size(q);
+		if (!limitsBegin(q) || !deadlineBegin(q)) {
+			limitsEnd();
+			deadlineEnd();
+			closeHereDocs();
+			return 0;
+		}
+	} while (size(q) != i);
+	i = execCommand(q);	// command execution
+	limitsEnd();
+	deadlineEnd();
+	closeHereDocs();
+	return i;
 }
\ No newline at end of file
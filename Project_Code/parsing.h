@@ -2,6 +2,9 @@
 
 #define MAXCOMM 1000	// maximum number of commands (for example: "comm1 | comm2 | comm3 | ...")
 #define MAXCHARCOMM 1000	// maximum number of characters per command
+#define FANOUT "|&|"	// operator that sends the output of a pipeline also to the pipelines after it
+#define METER "|:"	// pipe with a meter of the data that passes through it
+#define MAXHEREDOC 64	// maximum number of here-documents in a command line
 
 /**************************************************************************************************************************
 Constants to change the color of the micro-bash writings.
@@ -13,20 +16,182 @@ Constants to change the color of the micro-bash writings.
 
 
 /**************************************************************************************************************************
-Function for printing the current directory.
+Stage Struct: a command of a pipeline with its arguments (NULL-terminated for execvp) and its redirections.
+segment is the number of the pipeline: 0 for the first one, then +1 after each "|&|".
+meter is 1 if the pipe from the previous command has a meter ("|:").
 **************************************************************************************************************************/
-void printCurDir();
+typedef struct {
+	char **argv, **redirs;
+	unsigned int argc, n_redirs, segment, meter;
+} stage;
+
+
+/**************************************************************************************************************************
+Types of redirection: "[n]<file", "[n]>file", "[n]>>file", "[n]>&m" or "[n]<&m", "[n]<<<word", "[n]<<DELIMITER".
+**************************************************************************************************************************/
+typedef enum {
+	R_IN,
+	R_OUT,
+	R_APPEND,
+	R_DUP,
+	R_HERESTRING,
+	R_HEREDOC
+} redir_type;
+
+
+/**************************************************************************************************************************
+Redir Struct: the file descriptor fd of the command is redirected to target (file, word, delimiter or file descriptor).
+**************************************************************************************************************************/
+typedef struct {
+	redir_type type;
+	int fd;
+	char *target;
+} redir;
+
+
+/**************************************************************************************************************************
+Action Struct: the file descriptor fd of the command becomes a copy of src, that is a file descriptor of the shell or, if
+dup is 1, a file descriptor of the command itself.
+**************************************************************************************************************************/
+typedef struct {
+	int fd, src;
+	unsigned int dup;
+} action;
+
+
+/**************************************************************************************************************************
+Relay Struct: the relay process reads from in and copies the data to the n targets.
+If meter is not 0 the relay is the meter of the pipe towards the command number meter (with only one target).
+**************************************************************************************************************************/
+typedef struct {
+	int in, *targets;
+	unsigned int n, meter;
+} relay;
+
+
+/**************************************************************************************************************************
+List of the file descriptors opened for a pipeline.
+**************************************************************************************************************************/
+typedef struct {
+	int *fds;
+	unsigned int n, dim;
+} fd_list;
+
+
+/**************************************************************************************************************************
+Pipeline Struct: what is prepared for the execution of the commands of a pipeline, before the forks.
+l has all the file descriptors opened for the pipeline, acts[i] are the n_acts[i] actions of the command i, fused[i] is 1
+if the command i is executed by the process of the previous one and relays are the n_relays relays of the shell.
+**************************************************************************************************************************/
+typedef struct {
+	fd_list l;
+	action **acts;
+	unsigned int *n_acts, *fused, n_relays;
+	relay *relays;
+} pipeline;
 
 
 /**************************************************************************************************************************
 Function that takes the input and checks the ctrl+D at the beginning of the line.
+A line too long is thrown away and becomes an empty line.
 It returns 0 if a ctrl + D was found or the input was not successful.
 **************************************************************************************************************************/
 unsigned int inputCommand(char *);
 
 
 /**************************************************************************************************************************
-Useful function to decompose the string inserted in input by the user.
+Function that returns 1 if the argument is a redirection (an optional number and then '<' or '>'), otherwise it returns 0.
+**************************************************************************************************************************/
+unsigned int isRedirection(const char *);
+
+
+/**************************************************************************************************************************
+Function that decomposes a redirection in type, file descriptor and target.
+It returns 0 if the redirection is not correct, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int parseRedir(char *, redir *);
+
+
+/**************************************************************************************************************************
+Function that checks that all the redirections are correct (for example that I don't have the ">" and then a space).
+The redirections can be in any command of the pipeline and in any position after the name of the command.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int checkErrorPipedCommand(queue *);
+
+
+/**************************************************************************************************************************
+Function that divides the queue into the commands of the pipelines, with their arguments and redirections.
+It returns NULL if some error occurred, otherwise it returns the array of the *n_stages commands.
+**************************************************************************************************************************/
+stage *buildStages(queue *, unsigned int *, unsigned int *);
+
+
+/**************************************************************************************************************************
+Function that reads the bodies of the here-documents of the command line, in order.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int readHereDocs(queue *);
+
+
+/**************************************************************************************************************************
+Function that closes the here-documents of the command line that have not been used.
+**************************************************************************************************************************/
+void closeHereDocs();
+
+
+/**************************************************************************************************************************
+Function that prepares the execution of the commands of a pipeline, without creating any process: the pipes, the files of
+the redirections and the actions of each command, the filters joined together and the relays.
+Each command reads from the pipe of the previous one and writes in the pipe of the next one, then its redirections are
+applied in the order in which they have been written (so they can replace the pipes).
+A file descriptor of a command with more outputs (more ">" of the same fd, or other pipelines after "|&|") is a pipe read
+by a relay process of the shell, which copies the data to all the outputs with tee(2) and splice(2).
+Adjacent builtin filters ("grep -F", "cut", "wc", "head") are executed by only one process (the first one can have
+redirections of the input and the last one of the output).
+pl has to be freed with freePipeline also if some error occurred (after closeFds on its file descriptors).
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int preparePipeline(stage *, unsigned int, unsigned int, pipeline *);
+
+
+/**************************************************************************************************************************
+Function that frees what preparePipeline has allocated for the n_stages commands (the file descriptors are not closed).
+**************************************************************************************************************************/
+void freePipeline(pipeline *, unsigned int);
+
+
+/**************************************************************************************************************************
+Function that closes all the file descriptors of the list, except the n ones in keep (keep can be NULL).
+**************************************************************************************************************************/
+void closeFds(fd_list *, const int *, unsigned int);
+
+
+/**************************************************************************************************************************
+Function that applies the actions of a command in the child process, in the order in which they have been written.
+The file descriptors of the shell are first moved above all the ones that are redirected, so that a redirection can't
+close the source of one of the next ones.
 It returns 0 if some error occurred, otherwise it returns 1.
 **************************************************************************************************************************/
-unsigned int parser(char *, queue *);
\ No newline at end of file
+unsigned int applyActions(action *, unsigned int);
+
+
+/**************************************************************************************************************************
+Function that splits the string entered in input by the user into the queue and checks the syntax of pipes and
+redirections, without executing anything.
+It returns 0 if some error occurred, otherwise it returns 1 (also for a line with only spaces, with the queue empty).
+**************************************************************************************************************************/
+unsigned int parseLine(char *, queue *);
+
+
+/**************************************************************************************************************************
+Useful function to decompose the string inserted in input by the user and to execute it.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int parser(char *, queue *);
+
+
+/**************************************************************************************************************************
+Function that frees the commands of a pipeline.
+**************************************************************************************************************************/
+void freeStages(stage *, unsigned int);
\ No newline at end of file
@@ -0,0 +1,158 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pwd.h>
+#include "prompt.h"
+
+static int interactive = 0;	// 1 if the standard input is a terminal
+static char *cwd = NULL;	// current directory, updated only by "cd"
+static size_t cwd_len = 0;
+static char *basename_cwd = NULL;	// last component of cwd
+static char *fixed = NULL;	// text of the segments SEG_TEXT, with the escapes already replaced
+static segment segs[MAXSEGMENTS];
+static unsigned int n_segs = 0;
+static char *buf = NULL;	// buffer in which the prompt is rendered, reused for every line
+static size_t buf_dim = 0;
+
+
+/**************************************************************************************************************************
+Function that adds a segment to the prompt, joining it to the previous one if they are both fixed text.
+**************************************************************************************************************************/
+static void addSegment(segment_type type, const char *text, size_t len)
+{
+	if (type == SEG_TEXT && n_segs > 0 && segs[n_segs - 1].type == SEG_TEXT && segs[n_segs - 1].text + segs[n_segs - 1].len == text) {
+		segs[n_segs - 1].len += len;
+		return;
+	}
+	if (n_segs < MAXSEGMENTS)
+		segs[n_segs++] = (segment) { type, text, len };
+}
+
+
+/**************************************************************************************************************************
+Function that compiles the format into segments. The escapes are: \w (current directory), \W (its last component),
+\u (user), \h (host), \$ ('#' for root, otherwise '$'), \n (new line), \e (escape, for the colors) and \\.
+The values that can't change during the session (user, host, '$') are written once in the fixed text.
+**************************************************************************************************************************/
+static void compileFormat(const char *format)
+{
+	char host[256] = "", *user = getenv("USER"), *p;
+	struct passwd *pw;
+	size_t dim = strlen(format) + 1;
+	if (user == NULL && (pw = getpwuid(getuid())) != NULL)
+		user = pw->pw_name;
+	if (user == NULL)
+		user = "";
+	if (gethostname(host, sizeof(host) - 1) == 0 && (p = strchr(host, '.')) != NULL)
+		*p = '\0';
+	fixed = malloc(dim * (strlen(user) + strlen(host) + 1));	// more than the longest value for each character
+	p = fixed;
+	for (; *format; format++) {
+		const char *value = NULL;
+		char c[2] = { *format, '\0' };
+		if (*format == '\\' && format[1] != '\0') {
+			switch (*++format) {
+			case 'w':
+				addSegment(SEG_CWD, NULL, 0);
+				continue;
+			case 'W':
+				addSegment(SEG_BASENAME, NULL, 0);
+				continue;
+			case 'u':
+				value = user;
+				break;
+			case 'h':
+				value = host;
+				break;
+			case '$':
+				value = getuid() == 0 ? "#" : "$";
+				break;
+			case 'n':
+				value = "\n";
+				break;
+			case 'e':
+				value = "\x1b";
+				break;
+			default:	// "\\" and the unknown escapes are written as they are
+				c[0] = *format;
+			}
+		}
+		if (value == NULL)
+			value = c;
+		memcpy(p, value, strlen(value));
+		addSegment(SEG_TEXT, p, strlen(value));
+		p += strlen(value);
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that saves the current directory and compiles the format of the prompt (UBASH_PS1) into its segments.
+The prompt is disabled if the standard input is not a terminal.
+**************************************************************************************************************************/
+void promptInit()
+{
+	char *format = getenv(PROMPT_ENV);
+	if ((interactive = isatty(STDIN_FILENO)))	// with the commands from a file or a pipe there is no prompt
+		compileFormat(format != NULL ? format : PROMPT_DEFAULT);
+	promptChdir();
+}
+
+
+/**************************************************************************************************************************
+Function that updates the saved directory and the variables PWD and OLDPWD after a change of directory.
+**************************************************************************************************************************/
+void promptChdir()
+{
+	char *dir = get_current_dir_name();
+	size_t need = 0;
+	if (dir == NULL && cwd != NULL)	// the directory can't be read: I keep the last one
+		return;
+	if (dir == NULL)
+		dir = strdup("");
+	if (cwd != NULL)
+		setenv("OLDPWD", cwd, 1);
+	setenv("PWD", dir, 1);	// so the commands see the new directory in PWD
+	free(cwd);
+	cwd = dir;
+	cwd_len = strlen(cwd);
+	basename_cwd = strrchr(cwd, '/') != NULL && cwd[1] != '\0' ? strrchr(cwd, '/') + 1 : cwd;
+	if (!interactive)
+		return;
+	for (unsigned int i = 0; i < n_segs; i++)	// the buffer grows only if the new directory is longer
+		need += segs[i].type == SEG_TEXT ? segs[i].len : cwd_len;
+	if (need > buf_dim)
+		buf = realloc(buf, buf_dim = need);
+}
+
+
+/**************************************************************************************************************************
+Function for printing the prompt with the current directory.
+The segments are rendered in the buffer and written with only one write.
+**************************************************************************************************************************/
+void printCurDir()
+{
+	char *p = buf;
+	if (!interactive)
+		return;
+	for (unsigned int i = 0; i < n_segs; i++) {
+		const char *text = segs[i].text;
+		size_t len = segs[i].len;
+		if (segs[i].type == SEG_CWD) {
+			text = cwd;
+			len = cwd_len;
+		} else if (segs[i].type == SEG_BASENAME) {
+			text = basename_cwd;
+			len = strlen(basename_cwd);
+		}
+		memcpy(p, text, len);
+		p += len;
+	}
+	fflush(stdout);	// the messages still in the buffer of stdout must come before the prompt
+	if (write(STDOUT_FILENO, buf, p - buf) == -1)
+		return;
+}
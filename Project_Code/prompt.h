@@ -0,0 +1,43 @@
+#define PROMPT_ENV "UBASH_PS1"	// environment variable with the format of the prompt
+#define PROMPT_DEFAULT "\\e[32m\\w\\e[0m$ "	// format used if UBASH_PS1 is not set (the directory in green)
+#define MAXSEGMENTS 64	// maximum number of segments of the prompt
+
+
+/**************************************************************************************************************************
+Types of the segments of the prompt: a fixed text, the current directory or its last component.
+**************************************************************************************************************************/
+typedef enum {
+	SEG_TEXT,
+	SEG_CWD,
+	SEG_BASENAME
+} segment_type;
+
+
+/**************************************************************************************************************************
+Segment Struct.
+For SEG_TEXT text points to the len characters to write.
+**************************************************************************************************************************/
+typedef struct {
+	segment_type type;
+	const char *text;
+	size_t len;
+} segment;
+
+
+/**************************************************************************************************************************
+Function that saves the current directory and compiles the format of the prompt (UBASH_PS1) into its segments.
+The prompt is disabled if the standard input is not a terminal.
+**************************************************************************************************************************/
+void promptInit();
+
+
+/**************************************************************************************************************************
+Function that updates the saved directory and the variables PWD and OLDPWD after a change of directory.
+**************************************************************************************************************************/
+void promptChdir();
+
+
+/**************************************************************************************************************************
+Function for printing the prompt with the current directory.
+**************************************************************************************************************************/
+void printCurDir();
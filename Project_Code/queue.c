@@ -59,6 +59,8 @@ Function that returns 1 if there are two consecutive pipes in the queue, otherwi
 **************************************************************************************************************************/
 unsigned int checkPipeError(const queue * q)
 {
+	if (q->first == q->last)	// empty queue: there is no last item to check
+		return 0;
 	for (int i = q->first; i < q->last - 1; i++) {
 		if (q->array[i][0] == '|' && q->array[i + 1][0] == '|')
 			return 1;
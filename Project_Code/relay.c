@@ -0,0 +1,244 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <poll.h>
+#include "parsing.h"
+#include "trace.h"
+#include "relay.h"
+
+
+/**************************************************************************************************************************
+Function that throws away len bytes from the pipe in (when the target of the data has been closed by its reader).
+**************************************************************************************************************************/
+static void discard(int in, size_t len)
+{
+	char buf[4096];
+	ssize_t n;
+	while (len > 0 && (n = read(in, buf, len < sizeof(buf) ? len : sizeof(buf))) > 0)
+		len -= n;
+}
+
+
+/**************************************************************************************************************************
+Function that copies len bytes from in to out with read and write, for the targets that don't accept splice (for example
+the files opened in O_APPEND).
+It returns -1 if the reader of out has closed it, 0 if some other error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+static int copyAll(int in, int out, size_t len)
+{
+	char buf[65536];
+	ssize_t n, w;
+	while (len > 0) {
+		if ((n = read(in, buf, len < sizeof(buf) ? len : sizeof(buf))) <= 0)
+			return 0;
+		len -= n;
+		for (char *p = buf; n > 0; p += w, n -= w)
+			if ((w = write(out, p, n)) == -1) {
+				if (errno == EINTR) {
+					w = 0;
+					continue;
+				}
+				discard(in, len);
+				return errno == EPIPE ? -1 : 0;
+			}
+	}
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that moves exactly len bytes from the pipe in to out with splice, also with partial splices.
+If the reader of out has closed it the remaining bytes are thrown away, so that in remains aligned for the other targets.
+It returns -1 if the reader of out has closed it, 0 if some other error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+static int spliceAll(int in, int out, size_t len)
+{
+	ssize_t n;
+	while (len > 0) {
+		if ((n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EINVAL)	// the target doesn't support splice
+				return copyAll(in, out, len);
+			discard(in, len);
+			return errno == EPIPE ? -1 : 0;
+		}
+		if (n == 0)
+			return 0;
+		len -= n;
+	}
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function executed by the relay process of a fan-out: it copies everything that arrives on the pipe in to the n file
+descriptors of out (files or pipes), with tee(2) and splice(2), so that the data never passes through the user space.
+Each target except the last has its own empty pipe, as big as the pipe in: tee(2) duplicates the pages of in in it
+(without consuming them) and then they are moved to the target with splice(2); the last target consumes the data of in.
+The targets that are closed by the reader (EPIPE) are removed, the others continue to receive the data.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int teeRelay(int in, int *out, unsigned int n)
+{
+	int *mid = malloc(sizeof(int) * 2 * n);	// pipe in the middle for each target except the last one
+	int pipe_size = fcntl(in, F_GETPIPE_SZ);
+	unsigned int i, alive = n, ok = 1;
+	ssize_t len;
+	signal(SIGPIPE, SIG_IGN);	// a reader that closes the pipe must not kill the relay
+	for (i = 0; i + 1 < n; i++) {
+		if (pipe(mid + 2 * i) == -1) {
+			free(mid);
+			return 0;
+		}
+		if (pipe_size > 0)
+			fcntl(mid[2 * i + 1], F_SETPIPE_SZ, pipe_size);
+	}
+	while (alive > 0) {
+		// I wait for the data with a tee on the first target still active (or a splice if it is the only one)
+		i = 0;
+		while (out[i] < 0)
+			i++;
+		if (i + 1 < n)
+			len = tee(in, mid[2 * i + 1], RELAY_CHUNK, 0);
+		else if ((len = splice(in, NULL, out[i], NULL, RELAY_CHUNK, SPLICE_F_MOVE)) == -1 && errno == EINVAL) {
+			char buf[65536];	// the only target remained doesn't support splice
+			if ((len = read(in, buf, sizeof(buf))) > 0 && write(out[i], buf, len) == -1)
+				len = -1;
+		}
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len == -1 && errno == EPIPE) {	// the only target remained has been closed
+			out[i] = -1;
+			alive--;
+			continue;
+		}
+		if (len <= 0) {	// end of the data (or error)
+			ok = len == 0;
+			break;
+		}
+		if (i + 1 == n)	// the last target has already received the data with splice
+			continue;
+		for (unsigned int k = i + 1; k + 1 < n; k++)	// the middle pipe is empty and big enough: tee duplicates all len bytes
+			if (out[k] >= 0 && tee(in, mid[2 * k + 1], len, 0) != len)
+				ok = 0;
+		if (out[n - 1] >= 0) {	// the last target consumes the data of in
+			int r = spliceAll(in, out[n - 1], len);
+			if (r == -1) {
+				out[n - 1] = -1;
+				alive--;
+			}
+			if (r == 0)
+				ok = 0;
+		} else {
+			discard(in, len);
+		}
+		for (unsigned int k = i; k + 1 < n; k++) {	// I empty the middle pipes in their targets
+			if (out[k] < 0)
+				continue;
+			int r = spliceAll(mid[2 * k], out[k], len);
+			if (r == -1) {
+				out[k] = -1;
+				alive--;
+			}
+			if (r == 0)
+				ok = 0;
+		}
+	}
+	for (i = 0; i + 1 < n; i++) {
+		close(mid[2 * i]);
+		close(mid[2 * i + 1]);
+	}
+	free(mid);
+	return ok;
+}
+
+
+/**************************************************************************************************************************
+Function that waits until the file descriptor is ready for the events, at most until the time limit (0 for no limit).
+It adds the time waited to *waited and returns the events that happened (0 if the limit has been reached).
+**************************************************************************************************************************/
+static short waitReady(int fd, short events, uint64_t limit, uint64_t * waited)
+{
+	struct pollfd pfd = { fd, events, 0 };
+	uint64_t start = traceNow();
+	int r;
+	do {
+		uint64_t now = traceNow();
+		int timeout = limit == 0 ? -1 : now >= limit ? 0 : (int)((limit - now) / 1000000 + 1);
+		r = poll(&pfd, 1, timeout);
+	} while (r == -1 && errno == EINTR);
+	*waited += traceNow() - start;
+	return r > 0 ? pfd.revents : 0;
+}
+
+
+/**************************************************************************************************************************
+Function that prints the measures of a meter: bytes, rate and time waited for the input and for the output.
+**************************************************************************************************************************/
+static void printMeter(const char *from, const char *to, uint64_t bytes, double rate, uint64_t wait_in, uint64_t wait_out)
+{
+	fprintf(stderr, LIGHT_BLUE "[%s %s -> %s] %.1f MiB, %.1f MiB/s, senza dati %.2fs, bloccato %.2fs" RESET_COLOR "\n",
+		METER, from, to, bytes / 1048576.0, rate / 1048576.0, wait_in / 1e9, wait_out / 1e9);
+}
+
+
+/**************************************************************************************************************************
+Function executed by the relay process of a meter ("|:" or "set -o pipemeter"): it moves the data from the pipe in to out
+with splice(2) and measures the bytes, the rate and how long it has waited for the data (the command after the meter is
+starving) or for the space in out (the command before the meter is blocked).
+stage is the number of the command after the meter, from and to are the names of the two commands.
+It writes the measures on stderr, every second if stderr is a terminal, and a summary at the end (with no slow command if
+both waits are below METER_BALANCED_NS).
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int meterRelay(int in, int out, unsigned int stage, const char *from, const char *to)
+{
+	uint64_t begin = traceNow(), next = 0, bytes = 0, last_bytes = 0, wait_in = 0, wait_out = 0, end;
+	unsigned int ok = 1;
+	ssize_t len;
+	signal(SIGPIPE, SIG_IGN);	// a reader that closes the pipe must not kill the relay
+	if (isatty(STDERR_FILENO))	// the live measures only on the terminal
+		next = begin + METER_INTERVAL_NS;
+	while (1) {
+		short ev = waitReady(in, POLLIN, next, &wait_in);	// I wait for the data: the next command is starving
+		if (ev != 0 && !(ev & POLLERR))
+			ev = waitReady(out, POLLOUT, next, &wait_out);	// I wait for the space: the previous command is blocked
+		if (ev & POLLERR)	// the reader has closed the pipe
+			break;
+		if (ev != 0) {
+			len = splice(in, NULL, out, NULL, RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (len == 0)	// end of the data
+				break;
+			if (len == -1 && errno != EAGAIN && errno != EINTR) {
+				ok = errno == EPIPE;
+				break;
+			}
+			if (len > 0)
+				bytes += len;
+		}
+		if (next != 0 && traceNow() >= next) {	// live line with the rate of the last interval
+			printMeter(from, to, bytes, (bytes - last_bytes) * 1e9 / (traceNow() - next + METER_INTERVAL_NS), wait_in, wait_out);
+			last_bytes = bytes;
+			next = traceNow() + METER_INTERVAL_NS;
+		}
+	}
+	end = traceNow();
+	printMeter(from, to, bytes, bytes * 1e9 / (end - begin + 1), wait_in, wait_out);
+	if (wait_in < METER_BALANCED_NS && wait_out < METER_BALANCED_NS)	// no command has waited for the other one
+		fprintf(stderr, LIGHT_BLUE "[%s] i comandi %u (%s) e %u (%s) sono bilanciati: nessun collo di bottiglia" RESET_COLOR "\n",
+			METER, stage, from, stage + 1, to);
+	else if (wait_out > wait_in)	// who is slow: the command after the meter (the previous one is blocked) or the one before
+		fprintf(stderr, LIGHT_BLUE "[%s] il comando %u (%s) è lento: il comando %u (%s) resta bloccato" RESET_COLOR "\n",
+			METER, stage + 1, to, stage, from);
+	else
+		fprintf(stderr, LIGHT_BLUE "[%s] il comando %u (%s) è lento: il comando %u (%s) resta senza dati" RESET_COLOR "\n",
+			METER, stage, from, stage + 1, to);
+	return ok;
+}
@@ -0,0 +1,23 @@
+#define RELAY_CHUNK (1 << 20)	// maximum number of bytes moved with one tee/splice
+#define METER_INTERVAL_NS 1000000000LL	// interval between two lines of a meter on the terminal (1 s)
+#define METER_BALANCED_NS 10000000LL	// below this wait on both sides there is no slow command (10 ms)
+
+
+/**************************************************************************************************************************
+Function executed by the relay process of a fan-out: it copies everything that arrives on the pipe in to the n file
+descriptors of out (files or pipes), with tee(2) and splice(2), so that the data never passes through the user space.
+The targets that are closed by the reader (EPIPE) are removed, the others continue to receive the data.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int teeRelay(int, int *, unsigned int);
+
+
+/**************************************************************************************************************************
+Function executed by the relay process of a meter ("|:" or "set -o pipemeter"): it moves the data from the pipe in to out
+with splice(2) and measures the bytes, the rate and how long it has waited for the data (the command after the meter is
+starving) or for the space in out (the command before the meter is blocked).
+It writes the measures on stderr, every second if stderr is a terminal, and a summary at the end (with no slow command if
+both waits are below METER_BALANCED_NS).
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int meterRelay(int, int, unsigned int, const char *, const char *);
@@ -0,0 +1,466 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "parsing.h"
+#include "rlimits.h"
+
+#define CGROUP_PATH_LEN 4096	// maximum length of the path of a cgroup
+
+static limits cur = { -1, -1, -1, -1, -1, -1 };	// limits of the pipeline that is running
+static char cg_dir[CGROUP_PATH_LEN + 64];	// cgroup of the pipeline ("" if there is none)
+static int cg_procs = -1;	// file descriptor of cgroup.procs of the pipeline
+static unsigned int cg_count = 0;	// number of cgroups created (for the name of the next one)
+static unsigned int cg_warned = 0;	// 1 if I have already said that the cgroups are not available
+static char own_base[CGROUP_PATH_LEN];	// cgroup of the shell when it was started, where the pipelines are created
+static int own_ready = 0;	// 1 if own_base can be used, -1 if it can't, 0 if it has not been tried yet
+
+static const struct {
+	char opt;
+	int resource;
+	long long unit;	// bytes of a unit of the value written by the user
+	const char *descr;
+} ulimit_opts[] = {
+	{ 'c', RLIMIT_CORE, 1024, "dimensione file core (KB)" },
+	{ 'f', RLIMIT_FSIZE, 1024, "dimensione file (KB)" },
+	{ 'n', RLIMIT_NOFILE, 1, "file aperti" },
+	{ 's', RLIMIT_STACK, 1024, "dimensione stack (KB)" },
+	{ 't', RLIMIT_CPU, 1, "tempo CPU (secondi)" },
+	{ 'u', RLIMIT_NPROC, 1, "numero processi" },
+	{ 'v', RLIMIT_AS, 1024, "memoria virtuale (KB)" }
+};
+
+
+/**************************************************************************************************************************
+Function that converts a number with an optional K, M, G or T suffix (for example "2G").
+It returns -1 if the number is not correct or doesn't fit in a long long.
+**************************************************************************************************************************/
+static long long parseSize(const char *s)
+{
+	char *end;
+	int shift = 0;
+	long long n;
+	errno = 0;
+	n = strtoll(s, &end, 10);
+	if (end == s || n < 0 || errno == ERANGE)
+		return -1;
+	switch (*end) {
+	case 'T': case 't':
+		shift += 10;
+		/* fall through */
+	case 'G': case 'g':
+		shift += 10;
+		/* fall through */
+	case 'M': case 'm':
+		shift += 10;
+		/* fall through */
+	case 'K': case 'k':
+		shift += 10;
+		end++;
+		break;
+	}
+	if (*end != '\0' || n > (LLONG_MAX >> shift))	// the multiplication would overflow
+		return -1;
+	return n << shift;
+}
+
+
+/**************************************************************************************************************************
+Function that writes a string in a file of the cgroup of the pipeline.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+static unsigned int cgroupWrite(const char *dir, const char *file, const char *value)
+{
+	char path[CGROUP_PATH_LEN + 128];
+	int fd;
+	ssize_t len = strlen(value);
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	if ((fd = open(path, O_WRONLY | O_CLOEXEC)) < 0)
+		return 0;
+	if (write(fd, value, len) != len) {
+		close(fd);
+		return 0;
+	}
+	close(fd);
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that reads the value of a key (or the first number if key is NULL) from a file of the cgroup of the pipeline.
+It returns -1 if the value is not present.
+**************************************************************************************************************************/
+static long long cgroupRead(const char *file, const char *key)
+{
+	char path[CGROUP_PATH_LEN + 128], buf[4096], *p;
+	int fd;
+	ssize_t len;
+	snprintf(path, sizeof(path), "%s/%s", cg_dir, file);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+	if (key == NULL)
+		return strtoll(buf, NULL, 10);
+	for (p = buf; (p = strstr(p, key)) != NULL; p++)
+		if ((p == buf || p[-1] == '\n') && p[strlen(key)] == ' ')	// the key must be a whole word at the beginning of the line
+			return strtoll(p + strlen(key), NULL, 10);
+	return -1;
+}
+
+
+/**************************************************************************************************************************
+Function that reads the cgroup v2 of the shell (from /proc/self/cgroup) in the cgroup2 mount point.
+It returns 0 if it is not found, otherwise it returns 1.
+**************************************************************************************************************************/
+static unsigned int cgroupOwn(char *base)
+{
+	char line[CGROUP_PATH_LEN], mnt[CGROUP_PATH_LEN] = "", type[64];
+	FILE *f;
+	if ((f = fopen("/proc/self/mounts", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL)	// I search for the mount point of the cgroup2 filesystem
+		if (sscanf(line, "%*s %4095s %63s", mnt, type) == 2 && strcmp(type, "cgroup2") == 0)
+			break;
+		else
+			mnt[0] = '\0';
+	fclose(f);
+	if (mnt[0] == '\0' || (f = fopen("/proc/self/cgroup", "r")) == NULL)
+		return 0;
+	base[0] = '\0';
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (strncmp(line, "0::", 3) == 0) {	// the cgroup v2 line is "0::/path"
+			line[strcspn(line, "\n")] = '\0';
+			if (snprintf(base, CGROUP_PATH_LEN, "%s%s", mnt, strcmp(line + 3, "/") == 0 ? "" : line + 3) >= CGROUP_PATH_LEN)
+				base[0] = '\0';	// path too long
+			break;
+		}
+	fclose(f);
+	return base[0] != '\0' && access(base, W_OK) == 0;
+}
+
+
+/**************************************************************************************************************************
+Function that enables the memory and cpu controllers for the children of base.
+cgroup v2 doesn't allow it if base contains processes (no internal processes rule), so in the cgroup of the shell (own
+is 1) I move the shell in the leaf CGROUP_SHELL_LEAF and I try again; it still fails if base has other processes, and in
+this case the shell goes back in base.
+It returns 0 if the controllers can't be enabled, otherwise it returns 1.
+**************************************************************************************************************************/
+static unsigned int cgroupEnable(const char *base, unsigned int own)
+{
+	char leaf[CGROUP_PATH_LEN + 64];
+	if (cgroupWrite(base, "cgroup.subtree_control", "+memory +cpu"))
+		return 1;
+	if (errno != EBUSY || !own)
+		return 0;
+	snprintf(leaf, sizeof(leaf), "%s/%s", base, CGROUP_SHELL_LEAF);
+	if (mkdir(leaf, 0755) == -1 && errno != EEXIST)
+		return 0;
+	if (cgroupWrite(leaf, "cgroup.procs", "0") && cgroupWrite(base, "cgroup.subtree_control", "+memory +cpu"))	// "0": the shell
+		return 1;
+	// base has other processes: the shell goes back in base and the leaf is removed (if another shell doesn't use it)
+	cgroupWrite(base, "cgroup.procs", "0");
+	rmdir(leaf);
+	return 0;
+}
+
+
+/**************************************************************************************************************************
+Function that finds the cgroup v2 directory in which the shell can create the cgroups of the pipelines, with the memory
+and cpu controllers enabled: UBASH_CGROUP if it is set, otherwise the cgroup of the shell (found and prepared only the
+first time, because then the shell is in its leaf).
+It returns 0 if no directory can be used, otherwise it returns 1.
+**************************************************************************************************************************/
+static unsigned int cgroupBase(char *base)
+{
+	char *env = getenv(CGROUP_ENV);
+	if (env != NULL && env[0] != '\0') {
+		snprintf(base, CGROUP_PATH_LEN, "%s", env);
+		return access(base, W_OK) == 0 && cgroupEnable(base, 0);
+	}
+	if (own_ready == 0)
+		own_ready = cgroupOwn(own_base) && cgroupEnable(own_base, 1) ? 1 : -1;
+	snprintf(base, CGROUP_PATH_LEN, "%s", own_base);
+	return own_ready == 1;
+}
+
+
+/**************************************************************************************************************************
+Function that creates the cgroup of the pipeline with memory.max and cpu.max.
+If the cgroups can't be used the pipeline is executed with the setrlimit only.
+**************************************************************************************************************************/
+static void cgroupCreate()
+{
+	char base[CGROUP_PATH_LEN], value[64];
+	unsigned int ok = 1;
+	if (cg_dir[0] != '\0')	// the cgroup of the pipeline already exists
+		return;
+	if (!cgroupBase(base)) {
+		ok = 0;
+	} else {
+		snprintf(cg_dir, sizeof(cg_dir), "%s/ubash-%d-%u", base, getpid(), cg_count++);
+		if (mkdir(cg_dir, 0755) == -1) {
+			cg_dir[0] = '\0';
+			ok = 0;
+		}
+	}
+	if (ok && cur.mem >= 0) {
+		snprintf(value, sizeof(value), "%lld", cur.mem);
+		ok = cgroupWrite(cg_dir, "memory.max", value);
+	}
+	if (ok && cur.cpu >= 0) {
+		snprintf(value, sizeof(value), "%lld %d", cur.cpu, CGROUP_PERIOD);
+		ok = cgroupWrite(cg_dir, "cpu.max", value);
+	}
+	if (ok) {
+		char path[CGROUP_PATH_LEN + 128];
+		snprintf(path, sizeof(path), "%s/cgroup.procs", cg_dir);
+		ok = (cg_procs = open(path, O_WRONLY | O_CLOEXEC)) >= 0;
+	}
+	if (!ok) {
+		if (cg_dir[0] != '\0')
+			rmdir(cg_dir);
+		cg_dir[0] = '\0';
+		if (!cg_warned) {
+			fprintf(stdout, LIGHT_BLUE "*** cgroup v2 non disponibili: applico solo i limiti con setrlimit ***" RESET_COLOR "\n");
+			cg_warned = 1;
+		}
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that reads the "limit --opt=value ..." prefix at the beginning of the queue and removes it from the queue.
+The options are: --mem=SIZE, --cpu=CORES, --time=SECONDS, --nofile=N, --nproc=N, --fsize=SIZE.
+If the memory or the CPU are limited it also creates the cgroup for the pipeline.
+It returns 0 if some error occurred, otherwise it returns 1 (also when there is no prefix).
+**************************************************************************************************************************/
+unsigned int limitsBegin(queue * q)
+{
+	char *opt, *value;
+	long long v;
+	if (isEmpty(q) || strcmp(q->array[q->first], "limit") != 0)
+		return 1;
+	dequeue(q);
+	while (!isEmpty(q) && strncmp(q->array[q->first], "--", 2) == 0) {
+		opt = dequeue(q) + 2;
+		if ((value = strchr(opt, '=')) == NULL) {
+			fprintf(stdout, RED "micro-bash: limit: --%s: manca il valore" RESET_COLOR "\n", opt);
+			limitsEnd();
+			return 0;
+		}
+		value++;
+		if (strncmp(opt, "cpu=", 4) == 0) {	// number of cores, also fractional (for example 1.5)
+			char *end;
+			double cores = strtod(value, &end);
+			v = (end == value || *end != '\0' || cores <= 0) ? -1 : (long long)(cores * CGROUP_PERIOD);
+			cur.cpu = v;
+		} else {
+			v = parseSize(value);
+			if (strncmp(opt, "mem=", 4) == 0)
+				cur.mem = v;
+			else if (strncmp(opt, "time=", 5) == 0)
+				cur.time = v;
+			else if (strncmp(opt, "nofile=", 7) == 0)
+				cur.nofile = v;
+			else if (strncmp(opt, "nproc=", 6) == 0)
+				cur.nproc = v;
+			else if (strncmp(opt, "fsize=", 6) == 0)
+				cur.fsize = v;
+			else {
+				fprintf(stdout, RED "micro-bash: limit: --%s: opzione non valida" RESET_COLOR "\n", opt);
+				limitsEnd();
+				return 0;
+			}
+		}
+		if (v < 0) {
+			fprintf(stdout, RED "micro-bash: limit: --%s: valore non valido" RESET_COLOR "\n", opt);
+			limitsEnd();
+			return 0;
+		}
+	}
+	if (isEmpty(q)) {	// "limit" without a command
+		fprintf(stdout, RED "*** COMANDO ERRATO!!! ***" RESET_COLOR "\n");
+		limitsEnd();
+		return 0;
+	}
+	if (cur.mem >= 0 || cur.cpu >= 0)
+		cgroupCreate();
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that sets both the soft and the hard limit of a resource, if it has been requested.
+**************************************************************************************************************************/
+static void setLimit(int resource, long long value)
+{
+	struct rlimit rl;
+	if (value < 0)
+		return;
+	rl.rlim_cur = rl.rlim_max = value;
+	setrlimit(resource, &rl);
+}
+
+
+/**************************************************************************************************************************
+Function to be used by a child process before the execvp: it applies the setrlimit and moves the process in the cgroup.
+The memory is limited with RLIMIT_AS (address space) only without cgroup, because it also counts the address ranges that
+are reserved and not used (for example by the JVM and by Go).
+**************************************************************************************************************************/
+void limitsChild()
+{
+	if (cg_procs < 0)
+		setLimit(RLIMIT_AS, cur.mem);
+	setLimit(RLIMIT_CPU, cur.time);
+	setLimit(RLIMIT_NOFILE, cur.nofile);
+	setLimit(RLIMIT_NPROC, cur.nproc);
+	setLimit(RLIMIT_FSIZE, cur.fsize);
+	if (cg_procs >= 0 && write(cg_procs, "0", 1) == -1)	// "0" moves the process that writes
+		perror("Errore nello spostamento nel cgroup\n");
+}
+
+
+/**************************************************************************************************************************
+Function that removes the cgroup of a pipeline. The kernel can still count the processes that are terminating for a short
+time, so it tries again for CGROUP_RMDIR_TRIES milliseconds; if the cgroup still has processes (for example a command in
+background of the pipeline) it is left and the shell says it.
+**************************************************************************************************************************/
+static void cgroupRemove(const char *dir)
+{
+	struct timespec pause = { 0, 1000000 };
+	for (int i = 0; rmdir(dir) == -1; i++) {
+		if (errno != EBUSY || i == CGROUP_RMDIR_TRIES) {
+			fprintf(stdout, LIGHT_BLUE "*** Impossibile rimuovere il cgroup %s: %s ***" RESET_COLOR "\n", dir, strerror(errno));
+			return;
+		}
+		nanosleep(&pause, NULL);
+	}
+}
+
+
+/**************************************************************************************************************************
+Function to be used when all the processes of the pipeline have terminated: it prints the memory and CPU used, read from
+the cgroup, removes the cgroup and forgets the limits.
+**************************************************************************************************************************/
+void limitsEnd()
+{
+	long long peak, usage, oom;
+	if (cg_dir[0] != '\0') {
+		peak = cgroupRead("memory.peak", NULL);	// memory.peak is present only from Linux 5.19
+		usage = cgroupRead("cpu.stat", "usage_usec");
+		oom = cgroupRead("memory.events", "oom_kill");
+		fprintf(stdout, LIGHT_BLUE "Pipeline: picco memoria ");
+		if (peak >= 0)
+			fprintf(stdout, "%lld KB", peak / 1024);
+		else
+			fprintf(stdout, "n/d");
+		fprintf(stdout, ", CPU %.3f s", usage >= 0 ? usage / 1e6 : 0.0);
+		if (oom > 0)
+			fprintf(stdout, ", processi uccisi per memoria: %lld", oom);
+		fprintf(stdout, RESET_COLOR "\n");
+		close(cg_procs);
+		cg_procs = -1;
+		cgroupRemove(cg_dir);
+		cg_dir[0] = '\0';
+	}
+	cur.mem = cur.cpu = cur.time = cur.nofile = cur.nproc = cur.fsize = -1;
+}
+
+
+/**************************************************************************************************************************
+Function that prints the limit of a resource.
+**************************************************************************************************************************/
+static void printLimit(int i, unsigned int hard, unsigned int with_name)
+{
+	struct rlimit rl;
+	rlim_t value;
+	getrlimit(ulimit_opts[i].resource, &rl);
+	value = hard ? rl.rlim_max : rl.rlim_cur;
+	if (with_name)
+		fprintf(stdout, "%-26s (-%c) ", ulimit_opts[i].descr, ulimit_opts[i].opt);
+	if (value == RLIM_INFINITY)
+		fprintf(stdout, "unlimited\n");
+	else
+		fprintf(stdout, "%llu\n", (unsigned long long)value / ulimit_opts[i].unit);
+}
+
+
+/**************************************************************************************************************************
+Function for executing the "ulimit" command: "ulimit [-H] [-a | -c | -f | -n | -s | -t | -u | -v] [value|unlimited]".
+The limits are changed in the shell, so they are inherited by all the next commands.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int ulimit(char **arg, unsigned int num_arg)
+{
+	unsigned int hard = 0, i = 1;
+	int res = 1;	// by default "ulimit" works on the file size, like bash
+	int n_opts = sizeof(ulimit_opts) / sizeof(ulimit_opts[0]);
+	struct rlimit rl;
+	if (i < num_arg && strcmp(arg[i], "-H") == 0) {
+		hard = 1;
+		i++;
+	}
+	if (i < num_arg && arg[i][0] == '-') {
+		if (strcmp(arg[i], "-a") == 0) {
+			for (int k = 0; k < n_opts; k++)
+				printLimit(k, hard, 1);
+			return 1;
+		}
+		for (res = 0; res < n_opts; res++)
+			if (arg[i][1] == ulimit_opts[res].opt && arg[i][2] == '\0')
+				break;
+		if (res == n_opts) {
+			fprintf(stdout, RED "micro-bash: ulimit: %s: opzione non valida" RESET_COLOR "\n", arg[i]);
+			return 0;
+		}
+		i++;
+	}
+	if (i == num_arg) {	// without value I print the limit
+		printLimit(res, hard, 0);
+		return 1;
+	}
+	if (i + 1 < num_arg) {
+		fprintf(stdout, RED "micro-bash: ulimit: troppi argomenti" RESET_COLOR "\n");
+		return 0;
+	}
+	getrlimit(ulimit_opts[res].resource, &rl);
+	if (strcmp(arg[i], "unlimited") == 0) {
+		if (hard)
+			rl.rlim_max = RLIM_INFINITY;
+		else
+			rl.rlim_cur = rl.rlim_max;
+	} else {
+		char *end;
+		long long value;
+		errno = 0;
+		value = strtoll(arg[i], &end, 10);
+		if (end == arg[i] || *end != '\0' || value < 0 || errno == ERANGE
+		    || (unsigned long long)value > (RLIM_INFINITY - 1) / ulimit_opts[res].unit) {	// value * unit must fit
+			fprintf(stdout, RED "micro-bash: ulimit: %s: numero non valido" RESET_COLOR "\n", arg[i]);
+			return 0;
+		}
+		if (hard)
+			rl.rlim_max = value * ulimit_opts[res].unit;
+		else
+			rl.rlim_cur = value * ulimit_opts[res].unit;
+	}
+	if (rl.rlim_cur > rl.rlim_max)	// lowering the hard limit also lowers the soft one
+		rl.rlim_cur = rl.rlim_max;
+	if (setrlimit(ulimit_opts[res].resource, &rl) == -1) {
+		fprintf(stdout, RED "micro-bash: ulimit: impossibile modificare il limite" RESET_COLOR "\n");
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,42 @@
+#define CGROUP_ENV "UBASH_CGROUP"	// environment variable with a cgroup v2 directory delegated to the user
+#define CGROUP_PERIOD 100000	// period (in microseconds) used for cpu.max
+#define CGROUP_SHELL_LEAF "ubash-shell"	// leaf in which the shell moves itself when it uses its own cgroup
+#define CGROUP_RMDIR_TRIES 100	// attempts (one every millisecond) to remove the cgroup of a pipeline
+
+
+/**************************************************************************************************************************
+Struct with the limits requested with the "limit" prefix (-1 if the limit is not requested).
+mem is in bytes, cpu in microseconds of CPU for every CGROUP_PERIOD, time in seconds.
+**************************************************************************************************************************/
+typedef struct {
+	long long mem, cpu, time, nofile, nproc, fsize;
+} limits;
+
+
+/**************************************************************************************************************************
+Function that reads the "limit --opt=value ..." prefix at the beginning of the queue and removes it from the queue.
+If the memory or the CPU are limited it also creates the cgroup for the pipeline.
+It returns 0 if some error occurred, otherwise it returns 1 (also when there is no prefix).
+**************************************************************************************************************************/
+unsigned int limitsBegin(queue *);
+
+
+/**************************************************************************************************************************
+Function to be used by a child process before the execvp: it applies the setrlimit and moves the process in the cgroup.
+The memory is limited with RLIMIT_AS only without cgroup.
+**************************************************************************************************************************/
+void limitsChild();
+
+
+/**************************************************************************************************************************
+Function to be used when all the processes of the pipeline have terminated: it prints the memory and CPU used, read from
+the cgroup, removes the cgroup and forgets the limits.
+**************************************************************************************************************************/
+void limitsEnd();
+
+
+/**************************************************************************************************************************
+Function for executing the "ulimit" command.
+It returns 0 if some error occurred, otherwise it returns 1.
+**************************************************************************************************************************/
+unsigned int ulimit(char **, unsigned int);
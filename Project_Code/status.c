@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "parsing.h"
+#include "options.h"
+#include "status.h"
+
+int last_status = 0;
+
+static char statuses[MAXCOMM][MAXSTATUSLEN] = { "0" };	// statuses of the commands of the last pipeline, as text
+static unsigned int n_statuses = 1;
+static char pipestatus[MAXCOMM * MAXSTATUSLEN] = "0";	// the statuses written as "0 1 0"
+static char last[MAXSTATUSLEN] = "0";	// value of $?
+static unsigned int saved = 0;	// 1 if the statuses of the current command line have been saved
+
+
+/**************************************************************************************************************************
+Function called at the beginning of each command line: the statuses of the previous one are still valid until the new
+ones are saved.
+**************************************************************************************************************************/
+void statusLine()
+{
+	saved = 0;
+}
+
+
+/**************************************************************************************************************************
+Function that returns 1 if the statuses of the current command line have been saved, otherwise it returns 0.
+**************************************************************************************************************************/
+unsigned int statusSaved()
+{
+	return saved;
+}
+
+
+/**************************************************************************************************************************
+Function that saves the exit status of a command line that doesn't execute a pipeline (builtin or error).
+**************************************************************************************************************************/
+void setStatus(int status)
+{
+	last_status = status & 0xff;
+	n_statuses = 1;
+	sprintf(statuses[0], "%d", last_status);
+	strcpy(pipestatus, statuses[0]);
+	strcpy(last, statuses[0]);
+	saved = 1;
+}
+
+
+/**************************************************************************************************************************
+Function that saves the statuses (as returned by waitpid) of the n commands of a pipeline, in the order of the commands.
+A command killed by a signal has status 128 + signal, like in bash.
+$? is the status of the last command or, with "set -o pipefail", the last status that is not 0.
+**************************************************************************************************************************/
+void setPipeStatus(const int *status, unsigned int n)
+{
+	char *p = pipestatus;
+	last_status = 0;
+	for (n_statuses = 0; n_statuses < n && n_statuses < MAXCOMM; n_statuses++) {
+		int s = WIFSIGNALED(status[n_statuses]) ? 128 + WTERMSIG(status[n_statuses]) : WEXITSTATUS(status[n_statuses]);
+		if (s != 0 || !opts.pipefail)
+			last_status = s;
+		sprintf(statuses[n_statuses], "%d", s & 0xff);
+		p += sprintf(p, n_statuses == 0 ? "%s" : " %s", statuses[n_statuses]);
+	}
+	sprintf(last, "%d", last_status & 0xff);
+	saved = 1;
+}
+
+
+/**************************************************************************************************************************
+Function that returns the value of the variables "?", "PIPESTATUS" (all the statuses separated by spaces) and
+"PIPESTATUS[i]" (the status of the command i, from 0).
+The values are saved as text when the statuses change, so each argument has its own string.
+It returns NULL if the name is not one of them.
+**************************************************************************************************************************/
+char *statusVar(const char *name)
+{
+	char *end;
+	long i;
+	if (strcmp(name, "?") == 0)
+		return last;
+	if (strcmp(name, "PIPESTATUS") == 0)
+		return pipestatus;
+	if (strncmp(name, "PIPESTATUS[", 11) != 0)
+		return NULL;
+	i = strtol(name + 11, &end, 10);
+	if (end == name + 11 || strcmp(end, "]") != 0 || i < 0 || i >= n_statuses)
+		return NULL;
+	return statuses[i];
+}
@@ -0,0 +1,41 @@
+#define MAXSTATUSLEN 4	// characters of an exit status in PIPESTATUS (up to 255 and the space)
+
+
+/**************************************************************************************************************************
+Exit status of the last command line ($?).
+**************************************************************************************************************************/
+extern int last_status;
+
+
+/**************************************************************************************************************************
+Function called at the beginning of each command line: the statuses of the previous one are still valid until the new
+ones are saved.
+**************************************************************************************************************************/
+void statusLine();
+
+
+/**************************************************************************************************************************
+Function that returns 1 if the statuses of the current command line have been saved, otherwise it returns 0.
+**************************************************************************************************************************/
+unsigned int statusSaved();
+
+
+/**************************************************************************************************************************
+Function that saves the exit status of a command line that doesn't execute a pipeline (builtin or error).
+**************************************************************************************************************************/
+void setStatus(int);
+
+
+/**************************************************************************************************************************
+Function that saves the statuses (as returned by waitpid) of the n commands of a pipeline, in the order of the commands.
+$? is the status of the last command or, with "set -o pipefail", the last status that is not 0.
+**************************************************************************************************************************/
+void setPipeStatus(const int *, unsigned int);
+
+
+/**************************************************************************************************************************
+Function that returns the value of the variables "?", "PIPESTATUS" (all the statuses separated by spaces) and
+"PIPESTATUS[i]" (the status of the command i, from 0).
+It returns NULL if the name is not one of them.
+**************************************************************************************************************************/
+char *statusVar(const char *);
@@ -0,0 +1,308 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "trace.h"
+
+#define TRACE_LINE_LEN (6 * TRACE_ARGV_LEN + 256)	// maximum length of a JSON line (the arguments can be escaped)
+
+int trace_on = 0;
+
+static int trace_fd = -1;	// file descriptor of the trace file
+static pid_t shell_pid;	// pid of the shell, saved once so as not to call getpid() for each event
+static trace_event ring[TRACE_RING_SIZE];
+static atomic_ulong head = 0;	// next slot written by the shell (only the shell moves it)
+static atomic_ulong tail = 0;	// next slot read by the writer thread (only the writer thread moves it)
+static atomic_ulong dropped = 0;	// events lost because the ring buffer was full
+static atomic_int stop = 0;	// 1 when the writer thread has to finish
+static atomic_int sleeping = 0;	// 1 when the writer thread found the ring buffer empty and is going to wait
+static int wake_fd = -1;	// eventfd on which the writer thread waits for new events
+static pthread_t writer;
+
+static const char *type_names[] = { "parse", "fork", "exec", "wait", "redir" };
+
+
+/**************************************************************************************************************************
+Function that returns the monotonic clock in nanoseconds.
+**************************************************************************************************************************/
+uint64_t traceNow()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+
+/**************************************************************************************************************************
+Function that copies the arguments in the event, cutting them if they are too long.
+**************************************************************************************************************************/
+static void fillArgv(trace_event * e, char *const *argv, int argc)
+{
+	size_t used = 0, len;
+	e->argc = 0;
+	if (argv == NULL)
+		return;
+	for (int i = 0; (argc < 0 || i < argc) && argv[i] != NULL; i++) {
+		len = strlen(argv[i]);
+		if (used + len + 1 > TRACE_ARGV_LEN)	// there is no more space: I keep the arguments copied up to now
+			break;
+		memcpy(e->argv + used, argv[i], len + 1);
+		used += len + 1;
+		e->argc++;
+	}
+}
+
+
+/**************************************************************************************************************************
+Functions that append a string or a number to the line that is being formatted.
+They don't use the stdio because the child processes call them after the fork.
+**************************************************************************************************************************/
+static char *putStr(char *p, const char *s)
+{
+	while (*s)
+		*p++ = *s++;
+	return p;
+}
+
+static char *putNum(char *p, long long n)
+{
+	char tmp[24];
+	int i = 0;
+	unsigned long long u = n < 0 ? -(unsigned long long)n : (unsigned long long)n;
+	if (n < 0)
+		*p++ = '-';
+	do {
+		tmp[i++] = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	while (i > 0)
+		*p++ = tmp[--i];
+	return p;
+}
+
+static char *putJsonStr(char *p, const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	*p++ = '"';
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\') {
+			*p++ = '\\';
+			*p++ = c;
+		} else if (c < 0x20) {	// control characters (for example '\t') as \u00XX
+			p = putStr(p, "\\u00");
+			*p++ = hex[c >> 4];
+			*p++ = hex[c & 0xf];
+		} else
+			*p++ = c;
+	}
+	*p++ = '"';
+	return p;
+}
+
+
+/**************************************************************************************************************************
+Function that writes the event as a JSON line in buf.
+It returns the length of the line.
+**************************************************************************************************************************/
+static size_t formatEvent(char *buf, const trace_event * e)
+{
+	char *p = buf;
+	const char *arg = e->argv;
+	p = putStr(p, "{\"ev\":\"");
+	p = putStr(p, type_names[e->type]);
+	p = putStr(p, "\",\"ts\":");
+	p = putNum(p, e->ts);
+	if (e->start != 0) {
+		p = putStr(p, ",\"start\":");
+		p = putNum(p, e->start);
+	}
+	p = putStr(p, ",\"pid\":");
+	p = putNum(p, e->pid);
+	p = putStr(p, ",\"status\":");
+	p = putNum(p, e->status);
+	p = putStr(p, ",\"argv\":[");
+	for (unsigned int i = 0; i < e->argc; i++) {
+		if (i > 0)
+			*p++ = ',';
+		p = putJsonStr(p, arg);
+		arg += strlen(arg) + 1;
+	}
+	p = putStr(p, "]}\n");
+	return p - buf;
+}
+
+
+/**************************************************************************************************************************
+Function that writes all the events present in the ring buffer in the trace file.
+**************************************************************************************************************************/
+static void flushRing()
+{
+	static char buf[64 * TRACE_LINE_LEN];
+	size_t used = 0;
+	unsigned long t = atomic_load_explicit(&tail, memory_order_relaxed);
+	unsigned long h = atomic_load_explicit(&head, memory_order_acquire);
+	unsigned long lost;
+	while (t != h) {
+		used += formatEvent(buf + used, &ring[t & (TRACE_RING_SIZE - 1)]);
+		t++;
+		atomic_store_explicit(&tail, t, memory_order_release);	// the slot can be written again by the shell
+		if (used > sizeof(buf) - TRACE_LINE_LEN || t == h) {
+			if (write(trace_fd, buf, used) == -1)
+				break;
+			used = 0;
+		}
+	}
+	if ((lost = atomic_exchange(&dropped, 0)) > 0) {	// I also write how many events have been lost
+		char *p = putStr(buf, "{\"ev\":\"dropped\",\"ts\":");
+		p = putNum(p, traceNow());
+		p = putStr(p, ",\"count\":");
+		p = putNum(p, lost);
+		p = putStr(p, "}\n");
+		if (write(trace_fd, buf, p - buf) == -1)
+			return;
+	}
+}
+
+
+/**************************************************************************************************************************
+Function that wakes up the writer thread.
+**************************************************************************************************************************/
+static void wakeWriter()
+{
+	uint64_t one = 1;
+	if (write(wake_fd, &one, sizeof(one)) == -1)
+		return;
+}
+
+
+/**************************************************************************************************************************
+Writer thread: it empties the ring buffer and then it blocks on the eventfd until the shell inserts a new event in the
+empty ring buffer or stops it, so when the shell is idle it doesn't wake up at all.
+Before blocking it sets sleeping and looks at head again: either it sees the new event or the shell sees sleeping and
+wakes it up, so no event remains in the ring buffer while it is waiting.
+**************************************************************************************************************************/
+static void *writerThread(void *arg)
+{
+	uint64_t count;
+	while (!atomic_load(&stop)) {
+		flushRing();
+		atomic_store(&sleeping, 1);
+		if (atomic_load(&head) == atomic_load_explicit(&tail, memory_order_relaxed) && !atomic_load(&stop))
+			if (read(wake_fd, &count, sizeof(count)) == -1 && errno != EINTR)
+				break;
+		atomic_store(&sleeping, 0);
+	}
+	flushRing();
+	return NULL;
+}
+
+
+/**************************************************************************************************************************
+Function that opens the trace file written in UBASH_TRACE and starts the writer thread.
+It returns 0 if some error occurred, otherwise it returns 1 (also when the trace is not requested).
+**************************************************************************************************************************/
+unsigned int traceInit()
+{
+	char *path = getenv(TRACE_ENV);
+	if (path == NULL || path[0] == '\0')	// trace not requested
+		return 1;
+	if ((trace_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666)) < 0)
+		return 0;
+	if ((wake_fd = eventfd(0, EFD_CLOEXEC)) < 0) {
+		close(trace_fd);
+		trace_fd = -1;
+		return 0;
+	}
+	shell_pid = getpid();
+	if (pthread_create(&writer, NULL, writerThread, NULL) != 0) {
+		close(wake_fd);
+		wake_fd = -1;
+		close(trace_fd);
+		trace_fd = -1;
+		return 0;
+	}
+	trace_on = 1;
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that stops the writer thread, writes the remaining events and closes the trace file.
+**************************************************************************************************************************/
+void traceClose()
+{
+	if (!trace_on)
+		return;
+	atomic_store(&stop, 1);
+	wakeWriter();
+	pthread_join(writer, NULL);
+	close(wake_fd);
+	wake_fd = -1;
+	close(trace_fd);
+	trace_fd = -1;
+	trace_on = 0;
+}
+
+
+/**************************************************************************************************************************
+Function that inserts an event in the ring buffer (only the shell process has to call it).
+If start is 0 the event has no duration. argv can have argc elements or be NULL-terminated (with argc -1).
+If the ring buffer is full the event is counted as lost, so the shell never waits for the writer thread.
+The writer thread is woken up only if it is waiting, that is when the ring buffer was empty.
+**************************************************************************************************************************/
+void traceEvent(trace_type type, uint64_t start, pid_t pid, char *const *argv, int argc, int status)
+{
+	trace_event *e;
+	unsigned long h;
+	if (!trace_on)
+		return;
+	h = atomic_load_explicit(&head, memory_order_relaxed);
+	if (h - atomic_load_explicit(&tail, memory_order_acquire) == TRACE_RING_SIZE) {
+		atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+		return;
+	}
+	e = &ring[h & (TRACE_RING_SIZE - 1)];
+	e->type = type;
+	e->start = start;
+	e->ts = traceNow();
+	e->pid = pid == 0 ? shell_pid : pid;
+	if (type == EV_WAIT)	// for the wait I save the exit status (128 + signal if the child was killed)
+		e->status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+	else
+		e->status = status;
+	fillArgv(e, argv, argc);
+	atomic_store(&head, h + 1);	// now the writer thread can read the event
+	if (atomic_exchange(&sleeping, 0))
+		wakeWriter();
+}
+
+
+/**************************************************************************************************************************
+Function that writes an event directly in the trace file, to be used by a child process before the execvp.
+The file is opened in O_APPEND, so the line is not mixed with the ones of the writer thread.
+**************************************************************************************************************************/
+void traceChild(trace_type type, char *const *argv, int status)
+{
+	trace_event e;
+	char buf[TRACE_LINE_LEN];
+	if (!trace_on)
+		return;
+	e.type = type;
+	e.start = 0;
+	e.ts = traceNow();
+	e.pid = getpid();
+	e.status = status;
+	fillArgv(&e, argv, -1);
+	if (write(trace_fd, buf, formatEvent(buf, &e)) == -1)
+		return;
+}
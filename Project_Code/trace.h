@@ -0,0 +1,72 @@
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TRACE_ENV "UBASH_TRACE"	// environment variable with the path of the trace file (tracing is off if it is not set)
+#define TRACE_RING_SIZE 1024	// number of events in the ring buffer (it must be a power of 2)
+#define TRACE_ARGV_LEN 256	// maximum number of characters of the arguments saved in an event
+
+
+/**************************************************************************************************************************
+Types of the events written in the trace.
+**************************************************************************************************************************/
+typedef enum {
+	EV_PARSE,
+	EV_FORK,
+	EV_EXEC,
+	EV_WAIT,
+	EV_REDIR
+} trace_type;
+
+
+/**************************************************************************************************************************
+Event Struct.
+The arguments are saved one after the other, each one terminated by '\0'.
+**************************************************************************************************************************/
+typedef struct {
+	trace_type type;
+	pid_t pid;
+	int status;
+	unsigned int argc;
+	uint64_t start, ts;
+	char argv[TRACE_ARGV_LEN];
+} trace_event;
+
+
+/**************************************************************************************************************************
+1 if the trace is active, otherwise 0.
+**************************************************************************************************************************/
+extern int trace_on;
+
+
+/**************************************************************************************************************************
+Function that returns the monotonic clock in nanoseconds.
+**************************************************************************************************************************/
+uint64_t traceNow();
+
+
+/**************************************************************************************************************************
+Function that opens the trace file written in UBASH_TRACE and starts the writer thread.
+It returns 0 if some error occurred, otherwise it returns 1 (also when the trace is not requested).
+**************************************************************************************************************************/
+unsigned int traceInit();
+
+
+/**************************************************************************************************************************
+Function that stops the writer thread, writes the remaining events and closes the trace file.
+**************************************************************************************************************************/
+void traceClose();
+
+
+/**************************************************************************************************************************
+Function that inserts an event in the ring buffer (only the shell process has to call it).
+If start is 0 the event has no duration. argv can have argc elements or be NULL-terminated (with argc -1).
+If the ring buffer is full the event is counted as lost, so the shell never waits for the writer thread.
+The writer thread is woken up only if it is waiting, that is when the ring buffer was empty.
+**************************************************************************************************************************/
+void traceEvent(trace_type, uint64_t, pid_t, char *const *, int, int);
+
+
+/**************************************************************************************************************************
+Function that writes an event directly in the trace file, to be used by a child process before the execvp.
+**************************************************************************************************************************/
+void traceChild(trace_type, char *const *, int);
@@ -1,27 +1,43 @@
 #include "parsing.h"
+#include "trace.h"
+#include "prompt.h"
+#include "options.h"
+#include "status.h"
+#include "coproc.h"
 
 
 /**************************************************************************************************************************
 Main.
-It returns 0 if some error occurred, otherwise it returns 1.
+It returns the exit status of the last command line ($?).
 **************************************************************************************************************************/
 int main(int argc, char **argv)
 {
 	char comm[MAXCHARCOMM];
 	queue q;
 	printf("\n##### uBASH - Laboratorio 2 di SET(i) 2019/2020 #####\n\n");
+	if (!traceInit())	// I start the trace if it has been requested with UBASH_TRACE
+		fprintf(stdout, RED "*** Impossibile aprire il file di trace ***" RESET_COLOR "\n");
+	promptInit();	// I save the directory and compile the prompt only once
 	while (1) {
 		printCurDir();
-		if (!inputCommand(comm))	// I take the input and check if there is ctrl+D
-			return 0;
+		if (!inputCommand(comm)) {	// I take the input and check if there is ctrl+D
+			coprocEnd();
+			traceClose();
+			return last_status;
+		}
 		if (comm[0] == '\n')	// if the user enters a '\n' in the first position of the input
 			continue;
+		coprocCheck();	// the coprocesses that have crashed are restarted before the line uses them
 		create(&q, MAXQUEUEELEM);
-		if (!parser(comm, &q)) {	// I execute the function for the parser
-			reset(&q);
-			continue;
-		}
+		statusLine();
+		if (!parser(comm, &q) && !statusSaved())	// the command line has not been executed (for example for a syntax error)
+			setStatus(1);
 		reset(&q);
+		if (opts.errexit && last_status != 0) {	// "set -e": the shell ends at the first error
+			coprocEnd();
+			traceClose();
+			return last_status;
+		}
 	}
 	return 1;
 }
\ No newline at end of file
@@ -0,0 +1,194 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include "parsing.h"
+#include "trace.h"
+#include "xargs.h"
+
+extern char **environ;
+
+static char **argv_batch;	// arguments of the execution: the command and then the items (reused for each batch)
+static unsigned int n_cmd;	// number of arguments of the command before the items
+static unsigned int running = 0, max_running = 1;	// processes in execution and maximum allowed (-P)
+static int result = 0;	// exit status of xargs
+static unsigned int null_stdin;	// 1 if the items are read from the standard input, that the commands must not read
+
+
+/**************************************************************************************************************************
+Function that returns the bytes used in the stack of the new process by a group of arguments.
+**************************************************************************************************************************/
+static long argsSize(char **args, unsigned int n)
+{
+	long size = 0;
+	for (unsigned int i = 0; (n == 0 || i < n) && args[i] != NULL; i++)
+		size += strlen(args[i]) + 1 + sizeof(char *);
+	return size;
+}
+
+
+/**************************************************************************************************************************
+Function that waits for one of the executions and updates the exit status of xargs.
+**************************************************************************************************************************/
+static void waitOne()
+{
+	int status;
+	while (wait(&status) == -1)
+		if (errno != EINTR)
+			return;
+	running--;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 127)
+		result = 127;
+	else if ((!WIFEXITED(status) || WEXITSTATUS(status) != 0) && result == 0)
+		result = 123;
+}
+
+
+/**************************************************************************************************************************
+Function that executes the command with the n items at the offsets offs of buf.
+After the fork argv_batch and the buffer can already be reused for the next batch.
+Like GNU xargs, when the items come from the standard input the command has /dev/null as input, so it cannot read the
+items of the next batches.
+**************************************************************************************************************************/
+static void runBatch(char *buf, size_t *offs, unsigned int n)
+{
+	pid_t pid;
+	for (unsigned int i = 0; i < n; i++)
+		argv_batch[n_cmd + i] = buf + offs[i];
+	argv_batch[n_cmd + n] = NULL;
+	if (running == max_running)	// I wait for a free place
+		waitOne();
+	fflush(stdout);
+	if ((pid = fork()) == 0) {
+		int null_fd;
+		if (null_stdin && ((null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC)) == -1 || dup2(null_fd, STDIN_FILENO) == -1)) {
+			perror("Errore apertura di /dev/null in xargs\n");
+			_exit(1);
+		}
+		traceChild(EV_EXEC, argv_batch, 0);
+		execvp(argv_batch[0], argv_batch);
+		fprintf(stdout, RED "*** COMANDO ERRATO!!! *** - Errore di: %s" RESET_COLOR "\n", argv_batch[0]);
+		fflush(stdout);
+		_exit(127);
+	}
+	if (pid == -1) {
+		perror("Errore fork in xargs\n");
+		result = 1;
+		return;
+	}
+	running++;
+}
+
+
+/**************************************************************************************************************************
+Function for executing the "xargs" command as a command of a pipeline:
+"xargs [-0] [-a file] [-n max] [-P procs] [command [args...]]".
+It reads the items (one per line, or separated by '\0' with -0) from the standard input or from the file, and executes
+the command with as many items as arguments as allowed by ARG_MAX (and the environment), up to procs at a time.
+The items are not copied: they are split inside the read buffer and the batch only contains their offsets.
+It returns the exit status: 0, 123 if some execution failed, 127 if the command doesn't exist, 1 for the other errors.
+**************************************************************************************************************************/
+int xargs(char **arg, unsigned int num_arg)
+{
+	static char *echo_argv[] = { "echo", NULL };
+	char delim = '\n', *buf, *p;
+	int fd = STDIN_FILENO;
+	unsigned int i = 1, max_items = 0, n_items = 0, eof = 0;
+	size_t cap = XARGS_BUF, len = 0, item = 0, scan = 0, *offs;
+	long limit, batch = 0;
+	char **cmd;
+	for (; i < num_arg && arg[i][0] == '-'; i++) {	// options
+		if (strcmp(arg[i], "-0") == 0) {
+			delim = '\0';
+		} else if (strcmp(arg[i], "-a") == 0 && i + 1 < num_arg) {
+			if ((fd = open(arg[++i], O_RDONLY | O_CLOEXEC)) == -1) {
+				fprintf(stdout, RED "micro-bash: xargs: %s: File o directory non esistente" RESET_COLOR "\n", arg[i]);
+				return 1;
+			}
+			posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		} else if (strcmp(arg[i], "-n") == 0 && i + 1 < num_arg && atoi(arg[i + 1]) > 0) {
+			max_items = atoi(arg[++i]);
+		} else if (strcmp(arg[i], "-P") == 0 && i + 1 < num_arg && atoi(arg[i + 1]) > 0) {
+			max_running = atoi(arg[++i]);
+		} else {
+			fprintf(stdout, RED "micro-bash: xargs: uso: xargs [-0] [-a file] [-n max] [-P proc] [comando [argomenti]]" RESET_COLOR "\n");
+			return 1;
+		}
+	}
+	null_stdin = fd == STDIN_FILENO;
+	cmd = i < num_arg ? arg + i : echo_argv;	// without command, like xargs, I use "echo"
+	n_cmd = i < num_arg ? num_arg - i : 1;
+	// space for the items: ARG_MAX less the environment, the command and the margin of POSIX
+	limit = sysconf(_SC_ARG_MAX) - argsSize(environ, 0) - argsSize(cmd, n_cmd) - sizeof(char *) - XARGS_HEADROOM;
+	if (limit <= 0) {
+		fprintf(stdout, RED "micro-bash: xargs: l'ambiente non lascia spazio per gli argomenti" RESET_COLOR "\n");
+		return 1;
+	}
+	// at most one item every 2 bytes (a character and the delimiter)
+	argv_batch = malloc(sizeof(char *) * (n_cmd + limit / (2 + sizeof(char *)) + 2));
+	offs = malloc(sizeof(size_t) * (limit / (2 + sizeof(char *)) + 1));
+	memcpy(argv_batch, cmd, sizeof(char *) * n_cmd);
+	buf = malloc(cap);
+	while (!eof) {
+		ssize_t r = read(fd, buf + len, cap - len - 1);	// 1 byte is left for the '\0' of the last item
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			eof = 1;
+			if (r == -1)
+				result = 1;
+			if (item < len)	// the last item has no delimiter
+				buf[len++] = delim;
+		}
+		len += r > 0 ? r : 0;
+		while ((p = memchr(buf + scan, delim, len - scan)) != NULL) {	// I split the items inside the buffer
+			size_t item_len = p - (buf + item);
+			long cost = item_len + 1 + sizeof(char *);
+			*p = '\0';
+			scan = p - buf + 1;
+			if (item_len == 0) {	// empty line
+				item = scan;
+				continue;
+			}
+			if (item_len >= XARGS_MAX_ARG_LEN || cost > limit) {
+				fprintf(stdout, RED "micro-bash: xargs: argomento troppo lungo" RESET_COLOR "\n");
+				result = 1;
+				item = scan;
+				continue;
+			}
+			if (n_items > 0 && (batch + cost > limit || n_items == max_items)) {	// the batch is full: I execute it
+				runBatch(buf, offs, n_items);
+				n_items = 0;
+				batch = 0;
+			}
+			offs[n_items++] = item;
+			batch += cost;
+			item = scan;
+		}
+		if (!eof && len == cap - 1) {	// the buffer is full: I keep only the items of the batch and the incomplete one
+			size_t keep = n_items > 0 ? offs[0] : item;
+			memmove(buf, buf + keep, len - keep);
+			for (i = 0; i < n_items; i++)
+				offs[i] -= keep;
+			len -= keep;
+			item -= keep;
+			scan -= keep;
+			if (len == cap - 1)	// an item doesn't fit in the buffer
+				buf = realloc(buf, cap *= 2);
+		}
+	}
+	if (n_items > 0)
+		runBatch(buf, offs, n_items);
+	while (running > 0)
+		waitOne();
+	if (fd != STDIN_FILENO)
+		close(fd);
+	free(buf);
+	free(offs);
+	free(argv_batch);
+	return result;
+}
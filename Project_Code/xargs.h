@@ -0,0 +1,13 @@
+#define XARGS_BUF (4 << 20)	// initial dimension of the buffer of the input (it grows if an item doesn't fit)
+#define XARGS_HEADROOM 2048	// bytes of ARG_MAX left free, as required by POSIX for xargs
+#define XARGS_MAX_ARG_LEN 131072	// maximum length of a single argument for Linux (MAX_ARG_STRLEN)
+
+
+/**************************************************************************************************************************
+Function for executing the "xargs" command as a command of a pipeline:
+"xargs [-0] [-a file] [-n max] [-P procs] [command [args...]]".
+It reads the items (one per line, or separated by '\0' with -0) from the standard input or from the file, and executes
+the command with as many items as arguments as allowed by ARG_MAX (and the environment), up to procs at a time.
+It returns the exit status: 0, 123 if some execution failed, 127 if the command doesn't exist, 1 for the other errors.
+**************************************************************************************************************************/
+int xargs(char **, unsigned int);
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Benchmark of the coprocesses of uBASH: N requests (100 by default) sent to a Python worker started once with
+# "coproc W worker" and ">&W" / "<&W", against N executions of the same worker started for each request.
+# It prints the latency of a request in both cases and checks that the answers are the same.
+# Usage: ./bench_coproc.sh [N]   (the shell is ./Project_Code/ubash, or the one written in UBASH)
+[ $# -le 1 ] || { echo "uso: $0 [richieste]" >&2; exit 1; }
+n=${1:-100}
+shell=$(realpath "${UBASH:-./Project_Code/ubash}")
+command -v python3 > /dev/null || { echo "$0: serve python3 per il worker" >&2; exit 1; }
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+cat > worker.py <<'WORKER'
+#!/usr/bin/env python3
+import sys, json, decimal	# the imports make the startup realistic
+for line in sys.stdin:
+	sys.stdout.write(json.dumps({"request": line.strip(), "length": len(line.strip())}) + "\n")
+	sys.stdout.flush()
+WORKER
+chmod +x worker.py
+
+# it prints the time of a list of commands of ubash and the time of a request: run name file_of_commands
+run() {
+	start=$(date +%s%N)
+	"$shell" < "$2" > /dev/null 2>&1
+	end=$(date +%s%N)
+	printf "%-24s %8d ms totali %8d us per richiesta\n" "$1" "$(((end - start) / 1000000))" "$(((end - start) / 1000 / n))"
+}
+
+i=0
+while [ $i -lt "$n" ]; do
+	echo "echo richiesta$i | ./worker.py >>spawn.txt" >> spawn.cmd
+	echo "echo richiesta$i >&W" >> coproc.cmd
+	echo "head -n 1 <&W >>coproc.txt" >> coproc.cmd
+	i=$((i + 1))
+done
+sed -i '1i coproc W ./worker.py' coproc.cmd
+echo "coproc -k W" >> coproc.cmd
+echo "$n richieste"
+run "processo per richiesta" spawn.cmd
+run "coproc" coproc.cmd
+[ "$(wc -l < coproc.txt)" -eq "$n" ] && cmp -s spawn.txt coproc.txt || { echo "ERRORE: le risposte sono diverse" >&2; exit 1; }
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Benchmark of the output fan-out of uBASH (tee(2) and splice(2)) against tee(1) on a stream of MB megabytes (2048 by
+# default): "cmd >a >b" against "cmd | tee a >b", and "cmd |&| wc -c |&| wc -c" against "cmd | tee fifo | wc -c".
+# The files are written in a temporary directory (UBASH_BENCH_DIR if it is set) and compared at the end.
+# Usage: ./bench_fanout.sh [MB]   (the shell is ./Project_Code/ubash, or the one written in UBASH)
+[ $# -le 1 ] || { echo "uso: $0 [megabyte]" >&2; exit 1; }
+mb=${1:-2048}
+shell=$(realpath "${UBASH:-./Project_Code/ubash}")
+dir=$(mktemp -d "${UBASH_BENCH_DIR:-${TMPDIR:-/tmp}}/ubash-bench.XXXXXX") || exit 1
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+status=0
+
+# it prints the time of a command line and its throughput: run name command_line_of_ubash|-sh command_line_of_sh
+run() {
+	start=$(date +%s%N)
+	if [ "$2" = "-sh" ]; then
+		sh -c "$3"
+	else
+		echo "$2" | "$shell" > /dev/null 2>&1
+	fi
+	end=$(date +%s%N)
+	ms=$(((end - start) / 1000000))
+	printf "%-34s %8d ms %8d MB/s\n" "$1" "$ms" "$((mb * 1000 / (ms + 1)))"
+}
+
+# it checks that two files are equal
+same() {
+	cmp -s "$1" "$2" || { echo "ERRORE: $1 e $2 sono diversi" >&2; status=1; }
+}
+
+echo "flusso di $mb MB"
+run "ubash: >a >b" "head -c ${mb}M /dev/zero >a >b"
+run "tee(1): | tee a >b" "head -c ${mb}M /dev/zero | tee c >d"
+same a c
+same b d
+rm -f a b c d
+run "ubash: |&| wc -c |&| wc -c" "head -c ${mb}M /dev/zero |&| wc -c >a |&| wc -c >b"
+mkfifo fifo
+run "tee(1): | tee fifo | wc -c" -sh "wc -c < fifo > d & head -c ${mb}M /dev/zero | tee fifo | wc -c > c; wait"
+same a c
+same b d
+exit $status
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Benchmark of the builtin filters of uBASH ("grep -F", "cut", "wc" and "head", joined in one process) against the same
+# pipelines executed by sh with coreutils, on a generated file of about MB megabytes (1024 by default).
+# For every pipeline it prints the two times and checks that the outputs are the same.
+# Usage: ./bench_filters.sh [MB]   (the shell is ./Project_Code/ubash, or the one written in UBASH)
+[ $# -le 1 ] || { echo "uso: $0 [megabyte]" >&2; exit 1; }
+mb=${1:-1024}
+shell=$(realpath "${UBASH:-./Project_Code/ubash}")
+dir=$(mktemp -d "${UBASH_BENCH_DIR:-${TMPDIR:-/tmp}}/ubash-bench.XXXXXX") || exit 1
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+status=0
+
+# lines of about 40 bytes: number, key (1000 different ones), text
+awk -v lines=$((mb * 1024 * 1024 / 40)) 'BEGIN { for (i = 0; i < lines; i++) printf "%d\tkey%d\tvalue %d some text\n", i, i % 1000, i * 7 }' > input.txt
+echo "file di $(($(wc -c < input.txt) / 1024 / 1024)) MB"
+printf "%-58s %10s %10s\n" "pipeline" "ubash" "coreutils"
+
+# it executes a pipeline with ubash and with sh, prints the times and compares the outputs: run pipeline
+run() {
+	start=$(date +%s%N)
+	echo "$1 >ubash.txt" | "$shell" > /dev/null 2>&1
+	middle=$(date +%s%N)
+	sh -c "$1 >coreutils.txt"
+	end=$(date +%s%N)
+	printf "%-58s %7d ms %7d ms\n" "$1" "$(((middle - start) / 1000000))" "$(((end - middle) / 1000000))"
+	cmp -s ubash.txt coreutils.txt || { echo "ERRORE: output diverso per: $1" >&2; status=1; }
+}
+
+run "wc -l <input.txt"
+run "wc -l -w -c <input.txt"
+run "grep -F -c key999 <input.txt"
+run "grep -F key42 <input.txt | cut -f 1,3 | wc -l"
+run "cut -f 2 <input.txt | head -n 10000000 | wc -c"
+run "grep -F -v key1 <input.txt | head -n 5000000 | cut -f 3"
+exit $status
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Benchmark of the trace of uBASH: N commands "cd ." (100000 by default) executed without trace and with UBASH_TRACE,
+# each list executed R times (5 by default) keeping the best time. "cd ." is a builtin, so there are no forks and the
+# difference is only the cost of the trace in the shell (one parse event for each command, written by the writer thread).
+# It prints the time of a command in both cases and the overhead of the trace for each command, and checks that every
+# event is in the trace or counted in a "dropped" line (the shell doesn't wait when the ring buffer is full).
+# Usage: ./bench_trace.sh [N [R]]   (the shell is ./Project_Code/ubash, or the one written in UBASH)
+[ $# -le 2 ] || { echo "uso: $0 [comandi [ripetizioni]]" >&2; exit 1; }
+n=${1:-100000}
+r=${2:-5}
+shell=$(realpath "${UBASH:-./Project_Code/ubash}")
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+
+yes "cd ." | head -n "$n" > commands.txt
+
+# it prints the best time in nanoseconds of R executions of the list of commands: best [variable=value]
+best() {
+	min=0
+	k=0
+	while [ $k -lt "$r" ]; do
+		rm -f trace.jsonl
+		start=$(date +%s%N)
+		env "$@" "$shell" < commands.txt > /dev/null 2>&1
+		end=$(date +%s%N)
+		[ $min -eq 0 ] || [ $((end - start)) -lt $min ] && min=$((end - start))
+		k=$((k + 1))
+	done
+	echo $min
+}
+
+plain=$(best UBASH_TRACE=)
+traced=$(best UBASH_TRACE=trace.jsonl)
+echo "$n comandi, migliore di $r esecuzioni"
+printf "%-16s %10d ns per comando\n" "senza trace" "$((plain / n))"
+printf "%-16s %10d ns per comando\n" "con trace" "$((traced / n))"
+printf "%-16s %10d ns per comando\n" "costo trace" "$(((traced - plain) / n))"
+events=$(grep -c '"ev":"parse"' trace.jsonl)
+lost=$(sed -n 's/.*"ev":"dropped".*"count":\([0-9]*\).*/\1/p' trace.jsonl | awk '{ s += $1 } END { print s + 0 }')
+printf "%-16s %10d scritti, %d persi\n" "eventi" "$events" "$lost"
+[ $((events + lost)) -eq "$n" ] || { echo "ERRORE: la trace ha $events eventi parse e $lost persi su $n" >&2; exit 1; }
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Report of a build of uBASH: startup time and commands per second on a workload executed in batch mode.
+# The workload is executed in a temporary directory and it fails after UBASH_REPORT_TIMEOUT seconds (120 by default).
+# Usage: ./build_report.sh executable workload
+[ $# -eq 2 ] || { echo "uso: $0 eseguibile carico_di_lavoro" >&2; exit 1; }
+shell=$(realpath "$1")
+workload=$(realpath "$2")
+limit=${UBASH_REPORT_TIMEOUT:-120}
+runs=50
+start=$(date +%s%N)
+i=0
+while [ $i -lt $runs ]; do
+	timeout "$limit" "$shell" < /dev/null > /dev/null 2>&1
+	i=$((i + 1))
+done
+end=$(date +%s%N)
+startup=$(((end - start) / runs / 1000))
+commands=$(grep -c . "$workload")
+dir=$(mktemp -d)
+start=$(date +%s%N)
+(cd "$dir" && timeout "$limit" "$shell" < "$workload" > /dev/null 2>&1)
+status=$?
+end=$(date +%s%N)
+rm -rf "$dir"
+if [ $status -eq 124 ]; then
+	echo "$1: il carico di lavoro non termina in $limit s" >&2
+	exit 1
+fi
+echo "$1: avvio $startup us, $((commands * 1000000000 / (end - start + 1))) comandi/s ($commands comandi in $(((end - start) / 1000000)) ms)"
@@ -0,0 +1,80 @@
+#!/bin/sh
+# Differential runner: it executes each command line of the cases file with uBASH and with /bin/sh, in a new directory
+# with the same files, and compares the outputs and the files written. It also records the time of each case with uBASH
+# (the best of 3 runs) and compares it with the baseline UBASH_DIFF_BASELINE (fuzz/diff_times.txt by default, in the
+# repository): a case that becomes more than 2 times slower (plus 5 ms) is a regression. The baseline is written only
+# when UBASH_DIFF_UPDATE=1 (for example after adding cases); without it the runner fails.
+# It ends with status 1 if some output is different, some case is slower or has no time, so "make check" fails.
+# Usage: ./fuzz/diff_sh.sh ubash cases_file
+[ $# -eq 2 ] || { echo "uso: $0 eseguibile file_dei_casi" >&2; exit 1; }
+shell=$(realpath "$1")
+cases=$(realpath "$2")
+baseline=${UBASH_DIFF_BASELINE:-$(dirname "$0")/diff_times.txt}
+if [ ! -f "$baseline" ] && [ "$UBASH_DIFF_UPDATE" != 1 ]; then
+	echo "$0: manca il file dei tempi di riferimento $baseline (crearlo con UBASH_DIFF_UPDATE=1)" >&2
+	exit 1
+fi
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+status=0
+n=0
+failed=0
+
+# it executes the case with a shell in a new directory and writes its output and its files in a file:
+# execute ubash|sh case output_file (it prints the time in microseconds)
+execute() {
+	rm -rf "$work/dir"
+	mkdir "$work/dir"
+	seq 1 5000 > "$work/dir/in.txt"
+	start=$(date +%s%N)
+	if [ "$1" = ubash ]; then	# without the banner (first 3 lines) and the final ^D
+		(cd "$work/dir" && printf '%s\n' "$2" | timeout 10 "$shell" 2>&1) | sed '1,3d;$d' > "$3"
+	else
+		(cd "$work/dir" && timeout 10 sh -c "$2" 2>&1) > "$3"
+	fi
+	end=$(date +%s%N)
+	for f in $(ls "$work/dir" | sort); do
+		echo "--- $f" >> "$3"
+		cat "$work/dir/$f" >> "$3"
+	done
+	echo $(((end - start) / 1000))
+}
+
+: > "$work/times.txt"
+printf "%-4s %-62s %9s %9s %9s\n" "n" "caso" "ubash us" "sh us" "base us"
+while IFS= read -r line; do
+	case "$line" in
+	'#'* | '') continue ;;
+	esac
+	n=$((n + 1))
+	best=
+	for run in 1 2 3; do
+		t=$(execute ubash "$line" "$work/ubash.txt")
+		[ -z "$best" ] || [ "$t" -lt "$best" ] && best=$t
+	done
+	t_sh=$(execute sh "$line" "$work/sh.txt")
+	printf '%s\t%s\n' "$best" "$line" >> "$work/times.txt"	# the time and the case, so the cases can be added
+	base=$( [ -f "$baseline" ] && awk -F '\t' -v c="$line" '$2 == c { print $1 }' "$baseline")
+	result=ok
+	if ! cmp -s "$work/ubash.txt" "$work/sh.txt"; then
+		result="OUTPUT DIVERSO"
+		diff "$work/ubash.txt" "$work/sh.txt" | head -n 10 | sed 's/^/	/' >&2
+	elif [ "$UBASH_DIFF_UPDATE" = 1 ]; then
+		:
+	elif [ -z "$base" ]; then
+		result="SENZA TEMPO DI RIFERIMENTO"
+	elif [ "$best" -gt $((2 * base + 5000)) ]; then
+		result="PIU' LENTO"
+	fi
+	printf "%-4s %-62s %9s %9s %9s %s\n" "$n" "$line" "$best" "$t_sh" "${base:--}" "$result"
+	if [ "$result" != ok ]; then
+		failed=$((failed + 1))
+		status=1
+	fi
+done < "$cases"
+if [ "$UBASH_DIFF_UPDATE" = 1 ]; then
+	cp "$work/times.txt" "$baseline"
+	echo "tempi di riferimento scritti in $baseline"
+fi
+echo "$n casi, $failed falliti"
+exit $status
@@ -0,0 +1,209 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../Project_Code/parsing.h"
+#include "../Project_Code/deadline.h"
+
+#define FUZZ_EXEC_ENV "UBASH_FUZZ_EXEC"	// if it is 1 the harness also prepares the pipeline (executor with the exec stubbed)
+
+/**************************************************************************************************************************
+Fuzz harness of uBASH. The first line of the input is a command line, the rest is what the shell would read after it
+(the bodies of the here-documents).
+The parsing layer is always executed: tokenizing (parseLine, that also calls checkErrorPipedCommand and checkPipeError),
+the redirections (parseRedir), the division into commands (buildStages) and the "timeout" prefix.
+With UBASH_FUZZ_EXEC=1 the executor is also executed, with the exec stubbed out: the here-documents are read
+(readHereDocs), the pipeline is prepared (preparePipeline: pipes, files of the redirections, actions and relays) and a
+single child process applies the actions of each command (applyActions) and ends, without any execvp. The files are
+created in a temporary directory, and the lines with a '/' in a redirection are not executed, so that nothing outside it
+is written. At the end of each input no file descriptor can remain open.
+It is built with libFuzzer ("make fuzz", with clang), or without it as a program that executes the files given as
+arguments or, without arguments, the standard input ("make fuzz-replay", also usable with AFL:
+afl-fuzz -i fuzz/corpus -o findings -- build/fuzz/parse_replay).
+**************************************************************************************************************************/
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static unsigned int exec_mode = 0;
+static char work_dir[] = "/tmp/ubash-fuzz-XXXXXX";
+static int home_fd = -1;	// current directory of the program, where libFuzzer reads and writes the corpus
+
+
+/**************************************************************************************************************************
+Function that removes the directory of the files of the redirections, at the end of the program.
+**************************************************************************************************************************/
+static void removeWorkDir()
+{
+	rmdir(work_dir);
+}
+
+
+/**************************************************************************************************************************
+Function called once by libFuzzer: the error messages of the parser go in /dev/null and, for the executor, it creates the
+temporary directory of the files of the redirections.
+**************************************************************************************************************************/
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	char *mode = getenv(FUZZ_EXEC_ENV);
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		return 1;
+	exec_mode = mode != NULL && strcmp(mode, "1") == 0;
+	if (exec_mode) {
+		if (mkdtemp(work_dir) == NULL || (home_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+			perror("Errore nella directory temporanea del fuzzer");
+			exit(1);
+		}
+		atexit(removeWorkDir);
+	}
+	return 0;
+}
+
+
+/**************************************************************************************************************************
+Function that removes the files written by the redirections of the last input.
+**************************************************************************************************************************/
+static void cleanWorkDir()
+{
+	DIR *d = opendir(".");
+	struct dirent *e;
+	if (d == NULL)
+		return;
+	while ((e = readdir(d)) != NULL)
+		if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0)
+			unlink(e->d_name);
+	closedir(d);
+}
+
+
+/**************************************************************************************************************************
+Function that returns 1 if all the redirections of the queue write and read only in the temporary directory.
+**************************************************************************************************************************/
+static unsigned int localRedirections(queue * q)
+{
+	redir r;
+	for (int k = q->first; k < q->last; k++)
+		if (isRedirection(q->array[k]) && parseRedir(q->array[k], &r) && r.type != R_HEREDOC && r.type != R_HERESTRING
+		    && strchr(r.target, '/') != NULL)
+			return 0;
+	return 1;
+}
+
+
+/**************************************************************************************************************************
+Function that executes the pipeline of the queue with the exec stubbed out, in the temporary directory: after
+preparePipeline a child process applies the actions of each command, as the children of runPipedCommands do before the
+execvp, and ends. The standard input of the program is rest, so that the here-documents are read from it.
+**************************************************************************************************************************/
+static void stubExecute(queue * q, const uint8_t *rest, size_t size)
+{
+	stage *stages;
+	pipeline pl;
+	unsigned int n_stages, n_segments, i;
+	int fd = memfd_create("ubash-fuzz-stdin", MFD_CLOEXEC);
+	pid_t pid;
+	if (fd == -1)
+		return;
+	if (write(fd, rest, size) != (ssize_t) size || dup2(fd, STDIN_FILENO) == -1) {
+		close(fd);
+		return;
+	}
+	close(fd);
+	if (chdir(work_dir) == -1)
+		return;
+	rewind(stdin);	// the stdio reads from the beginning of the new standard input, without the end of file of the last one
+	if (readHereDocs(q) && deadlineBegin(q) && (stages = buildStages(q, &n_stages, &n_segments)) != NULL) {
+		if (preparePipeline(stages, n_stages, n_segments, &pl)) {
+			fflush(stdout);
+			if ((pid = fork()) == 0) {
+				for (i = 0; i < n_stages; i++)
+					if (!pl.fused[i] && !applyActions(pl.acts[i], pl.n_acts[i]))
+						break;
+				_exit(i == n_stages ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+			if (pid > 0)
+				waitpid(pid, NULL, 0);
+		}
+		closeFds(&pl.l, NULL, 0);
+		freePipeline(&pl, n_stages);
+		freeStages(stages, n_stages);
+	}
+	deadlineEnd();
+	closeHereDocs();
+	cleanWorkDir();
+	if (fchdir(home_fd) == -1)
+		abort();
+}
+
+
+/**************************************************************************************************************************
+Function called by libFuzzer for each input: the first line becomes a command line, as inputCommand would give it (at
+most MAXCHARCOMM - 1 characters, up to the first '\0').
+**************************************************************************************************************************/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	char line[MAXCHARCOMM];
+	queue q;
+	stage *stages;
+	redir r;
+	unsigned int n_stages, n_segments;
+	const uint8_t *nl = memchr(data, '\n', size);
+	size_t len = nl != NULL ? (size_t)(nl - data) : size;
+	int mark = dup(STDERR_FILENO), after;	// the lowest free file descriptor, to find the ones that remain open
+	if (len > MAXCHARCOMM - 1)
+		len = MAXCHARCOMM - 1;
+	memcpy(line, data, len);
+	line[len] = '\0';
+	create(&q, MAXQUEUEELEM);
+	if (parseLine(line, &q) && !isEmpty(&q)) {
+		for (int k = q.first; k < q.last; k++)
+			if (isRedirection(q.array[k]))
+				parseRedir(q.array[k], &r);
+		if (exec_mode && localRedirections(&q)) {
+			stubExecute(&q, nl != NULL ? nl + 1 : data + size, nl != NULL ? size - (nl + 1 - data) : 0);
+		} else {
+			if (deadlineBegin(&q) && (stages = buildStages(&q, &n_stages, &n_segments)) != NULL)
+				freeStages(stages, n_stages);
+			deadlineEnd();
+		}
+	}
+	reset(&q);
+	close(mark);
+	after = dup(STDERR_FILENO);
+	close(after);
+	if (after != mark)	// a file descriptor of the pipeline has not been closed
+		abort();
+	return 0;
+}
+
+
+#ifdef FUZZ_REPLAY
+/**************************************************************************************************************************
+Main without libFuzzer: it executes each file given as argument, or the standard input.
+**************************************************************************************************************************/
+int main(int argc, char **argv)
+{
+	static uint8_t buf[1 << 16];
+	size_t len;
+	FILE *f;
+	LLVMFuzzerInitialize(&argc, &argv);
+	for (int i = 1; i < argc || i == 1; i++) {
+		if ((f = argc > 1 ? fopen(argv[i], "rb") : stdin) == NULL) {
+			perror(argv[i]);
+			return 1;
+		}
+		len = fread(buf, 1, sizeof(buf), f);
+		if (f != stdin)
+			fclose(f);
+		LLVMFuzzerTestOneInput(buf, len);
+	}
+	return 0;
+}
+#endif
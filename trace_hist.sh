@@ -0,0 +1,58 @@
+#!/bin/sh
+# Latency histograms from a uBASH trace (written with UBASH_TRACE=file).
+# Usage: ./trace_hist.sh file.jsonl
+# For every command it prints the histogram of the time between the fork and the wait, and at the end the one of the parser.
+[ $# -eq 1 ] || { echo "uso: $0 file_di_trace" >&2; exit 1; }
+awk '
+function field(name,   r) {
+	if (match($0, "\"" name "\":-?[0-9]+")) {
+		r = substr($0, RSTART, RLENGTH)
+		sub(/.*:/, "", r)
+		return r + 0
+	}
+	return -1
+}
+function bucket(us,   b) {
+	for (b = 0; us >= 2 && b < 40; b++)
+		us /= 2
+	return b
+}
+function add(key, ns,   b) {
+	b = bucket(ns / 1000)
+	hist[key, b]++
+	count[key]++
+	sum[key] += ns
+	if (!(key in keys) || b < low[key])
+		low[key] = b
+	if (b > top[key])
+		top[key] = b
+	keys[key] = 1
+}
+{
+	ev = $0; sub(/^\{"ev":"/, "", ev); sub(/".*/, "", ev)
+	ts = field("ts"); pid = field("pid")
+	if (ev == "parse") {
+		add("(parser)", ts - field("start"))
+	} else if (ev == "fork") {
+		cmd = $0; sub(/.*"argv":\["/, "", cmd); sub(/".*/, "", cmd)
+		forked[pid] = field("start") > 0 ? field("start") : ts; name[pid] = cmd	# start: just before the fork
+	} else if (ev == "wait" && (pid in forked)) {
+		add(name[pid], ts - forked[pid])
+		delete forked[pid]
+	} else if (ev == "dropped") {
+		lost += field("count")
+	}
+}
+END {
+	for (k in keys) {
+		printf "%s: %d eventi, media %.1f us\n", k, count[k], sum[k] / count[k] / 1000
+		for (b = low[k]; b <= top[k]; b++) {
+			bar = ""
+			for (i = 0; i < 50 * hist[k, b] / count[k]; i++)
+				bar = bar "#"
+			printf "  < %8d us %6d %s\n", 2 ^ (b + 1), hist[k, b], bar
+		}
+	}
+	if (lost > 0)
+		printf "eventi persi: %d\n", lost
+}' "$1"